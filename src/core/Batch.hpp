@@ -0,0 +1,314 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+// Libraries
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include "QuadTree.hpp"
+
+using namespace std;
+
+/**
+ * @brief Result of compressing one image in a batch
+ * @param inputPath Input image path
+ * @param outputPath Output image path
+ * @param errorMessage Error message, empty if the image was compressed
+ * @param inputSize Input file size in bytes
+ * @param finalSize Compressed image size in bytes
+ */
+struct BatchResult {
+    string inputPath, outputPath, errorMessage;
+    size_t inputSize = 0, finalSize = 0;
+};
+
+/**
+ * @brief Compresses many images concurrently on a pool of worker threads
+ * @param mode Error calculation mode (1-5)
+ * @param minBlock Minimum block size in pixels
+ * @param threshold Error threshold value
+ * @param targetPercentage Target compression percentage (0-1)
+ * @param jobs Number of worker threads
+ * @param estimateSize Whether the target search predicts encoded sizes
+ * @param confirmSize Whether predicted thresholds are confirmed with real encodes
+ * @param lowMemory Whether every image is compressed in low-memory mode
+ * @param tileSize Side of a tile of every image in pixels, 0 to compress each image at once
+ * @param results Per-image results, in input order
+ * @param elapsedMs Wall-clock time of the whole batch in milliseconds
+ */
+class BatchCompressor {
+
+    private:
+        int mode, minBlock;
+        double threshold, targetPercentage;
+        int jobs;
+        bool estimateSize, confirmSize, lowMemory;
+        int tileSize;
+        vector<BatchResult> results;
+        double elapsedMs;
+
+        /**
+         * @brief Extract extension from a path
+         * @param path Full file path
+         * @return File extension without dot
+         */
+        static string getExtension(const string& path) {
+            size_t dotPos = path.find_last_of('.');
+            if (dotPos == string::npos) return "";
+            return path.substr(dotPos + 1);
+        }
+
+        /**
+         * @brief Check whether a path has a supported image extension
+         * @param path Full file path
+         * @return True for jpg, jpeg, and png
+         */
+        static bool isSupported(const string& path) {
+            string extension = getExtension(path);
+            return extension == "jpg" || extension == "jpeg" || extension == "png";
+        }
+
+        /**
+         * @brief Compress one image on the calling thread, with its own image context
+         * @param result Result to fill, with input and output paths already set
+         */
+        void compressOne(BatchResult& result) {
+            ImageContext ctx;
+            ctx.lowMemory = lowMemory;
+            string extension = getExtension(result.inputPath);
+            result.inputSize = Image::getOriginalSize(result.inputPath);
+
+            string errorMsg = Image::loadImage(ctx, result.inputPath, extension);
+            if (errorMsg.empty() && (long long)minBlock > (long long)ctx.imgWidth * ctx.imgHeight) {
+                errorMsg = "Minimum block size lebih dari luas image.";
+            }
+            if (!errorMsg.empty()) {
+                result.errorMessage = errorMsg;
+                return;
+            }
+
+            QuadTree qt(ctx, result.inputPath, mode, threshold, minBlock, targetPercentage, result.outputPath, "", extension);
+            qt.setSizeEstimation(estimateSize, confirmSize);
+            qt.setTileSize(tileSize);
+
+            if (targetPercentage == 0) qt.performQuadTree();
+            else qt.performBinserQuadTree(targetPercentage);
+
+            result.errorMessage = qt.getErrorMessage();
+            result.finalSize = qt.getFinalSize();
+        }
+
+    public:
+        /**
+         * @brief Constructor that sets the compression parameters shared by every image
+         * @param mode Error calculation mode
+         * @param threshold Error threshold
+         * @param minBlock Minimum block size
+         * @param targetPercentage Target compression percentage
+         * @param jobs Number of worker threads, 0 to use every hardware thread
+         */
+        BatchCompressor(int mode, double threshold, int minBlock, double targetPercentage, int jobs) {
+            this -> mode = mode;
+            this -> threshold = threshold;
+            this -> minBlock = minBlock;
+            this -> targetPercentage = targetPercentage;
+            this -> jobs = jobs > 0 ? jobs : max(1u, thread::hardware_concurrency());
+            this -> elapsedMs = 0;
+            this -> estimateSize = false;
+            this -> confirmSize = false;
+            this -> lowMemory = false;
+            this -> tileSize = 0;
+        }
+
+        /**
+         * @brief Choose how the target search of every image measures encoded sizes
+         * @param estimateSize Predict sizes from the leaf edges
+         * @param confirmSize Confirm predicted thresholds with real encodes
+         */
+        void setSizeEstimation(bool estimateSize, bool confirmSize) {
+            this -> estimateSize = estimateSize;
+            this -> confirmSize = confirmSize;
+        }
+
+        /**
+         * @brief Choose whether every image keeps only its decoded buffer and the smallest error tables
+         * @param lowMemory Compress in low-memory mode
+         */
+        void setLowMemory(bool lowMemory) {
+            this -> lowMemory = lowMemory;
+        }
+
+        /**
+         * @brief Compress every image tile by tile, the images are the same as without tiles
+         * @param tileSize Side of a tile in pixels, 0 to compress each image at once
+         */
+        void setTileSize(int tileSize) {
+            this -> tileSize = tileSize;
+        }
+
+        /**
+         * @brief Read the images of a directory, sorted, or the entries of a manifest file, in its order
+         * @param source Directory of images, or manifest with one "input[<TAB>output]" entry per line
+         * @param entries Output input and output paths, the output empty when the manifest gives none
+         * @return Empty string if successful, error message if failed
+         */
+        static string readEntries(const string& source, vector<pair<string, string>>& entries) {
+            entries.clear();
+            std::error_code error;
+
+            if (std::filesystem::is_directory(source, error)) {
+                std::filesystem::directory_iterator it(source, error), end;
+                for (; !error && it != end; it.increment(error)) {
+                    string path = it -> path().string();
+                    std::error_code fileError;
+                    if (it -> is_regular_file(fileError) && isSupported(path)) entries.push_back({path, ""});
+                }
+                if (error) return "Direktori-nya gagal dibaca: " + source;
+                sort(entries.begin(), entries.end());
+            }
+            else {
+                ifstream manifest(source);
+                if (!manifest) return "Ga ada direktori atau manifest-nya: " + source;
+
+                string line;
+                while (getline(manifest, line)) {
+                    if (!line.empty() && line.back() == '\r') line.pop_back();
+                    if (line.empty() || line[0] == '#') continue;
+
+                    // "input" or "input<TAB>output"
+                    size_t tab = line.find('\t');
+                    if (tab == string::npos) entries.push_back({line, ""});
+                    else entries.push_back({line.substr(0, tab), line.substr(tab + 1)});
+                }
+            }
+
+            if (entries.empty()) return "Ga ada image yang bisa di-compress di " + source;
+            return "";
+        }
+
+        /**
+         * @brief Collect the images to compress from a directory or a manifest file
+         * @param source Directory of images, or manifest with one "input[<TAB>output]" entry per line
+         * @param outputDir Directory for outputs without an explicit path in the manifest
+         * @return Empty string if successful, error message if failed
+         */
+        string collectInputs(const string& source, const string& outputDir) {
+            results.clear();
+            vector<pair<string, string>> entries;
+
+            string errorMsg = readEntries(source, entries);
+            if (!errorMsg.empty()) return errorMsg;
+
+            for (const auto& [input, output] : entries) {
+                BatchResult result;
+                result.inputPath = input;
+
+                if (!output.empty()) result.outputPath = output;
+                else if (!outputDir.empty()) result.outputPath = (std::filesystem::path(outputDir) / std::filesystem::path(input).filename()).string();
+                else return "Flag --output-dir wajib diisi untuk " + input;
+
+                if (!isSupported(input)) result.errorMessage = "Extension-nya ga didukung.";
+                else if (getExtension(result.outputPath) != getExtension(input)) result.errorMessage = "Extension output harus sama dengan input.";
+                results.push_back(result);
+            }
+
+            if (!outputDir.empty()) {
+                std::error_code error;
+                std::filesystem::create_directories(outputDir, error);
+                if (error) return "Direktori output-nya gagal dibuat: " + outputDir;
+            }
+            return "";
+        }
+
+        /**
+         * @brief Compress every collected image, each worker pulling the next image until none is left
+         */
+        void run() {
+            atomic<size_t> next(0);
+            auto start = chrono::steady_clock::now();
+
+            auto worker = [&]() {
+                size_t i;
+                while ((i = next.fetch_add(1)) < results.size()) {
+                    if (results[i].errorMessage.empty()) compressOne(results[i]);
+                }
+            };
+
+            int workerCount = min(jobs, (int)results.size());
+            vector<thread> workers;
+            for (int i = 0; i < workerCount; i++) workers.emplace_back(worker);
+            for (auto& t : workers) t.join();
+
+            elapsedMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        }
+
+        /**
+         * @brief Get the per-image results
+         * @return Results, in input order
+         */
+        const vector<BatchResult>& getResults() const {return results;}
+
+        /**
+         * @brief Get the number of worker threads
+         * @return Worker thread count
+         */
+        int getJobs() const {return jobs;}
+
+        /**
+         * @brief Get the wall-clock time of the whole batch
+         * @return Elapsed time in milliseconds
+         */
+        double getElapsedMs() const {return elapsedMs;}
+
+        /**
+         * @brief Get the number of images that failed
+         * @return Failed image count
+         */
+        int getFailedCount() const {
+            int failed = 0;
+            for (const auto& result : results) if (!result.errorMessage.empty()) failed++;
+            return failed;
+        }
+
+        /**
+         * @brief Get the total size of the input files that were compressed
+         * @return Total input size in bytes
+         */
+        size_t getTotalInputSize() const {
+            size_t total = 0;
+            for (const auto& result : results) if (result.errorMessage.empty()) total += result.inputSize;
+            return total;
+        }
+
+        /**
+         * @brief Get the total size of the compressed outputs
+         * @return Total output size in bytes
+         */
+        size_t getTotalFinalSize() const {
+            size_t total = 0;
+            for (const auto& result : results) if (result.errorMessage.empty()) total += result.finalSize;
+            return total;
+        }
+
+        /**
+         * @brief Get the throughput in images per second
+         * @return Compressed images per second
+         */
+        double getImagesPerSecond() const {
+            if (elapsedMs <= 0) return 0;
+            return (results.size() - getFailedCount()) / (elapsedMs / 1000.0);
+        }
+
+        /**
+         * @brief Get the throughput in megabytes of input per second
+         * @return Input megabytes per second
+         */
+        double getMegabytesPerSecond() const {
+            if (elapsedMs <= 0) return 0;
+            return (getTotalInputSize() / (1024.0 * 1024.0)) / (elapsedMs / 1000.0);
+        }
+};
+
+#endif
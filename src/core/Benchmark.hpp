@@ -0,0 +1,324 @@
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+// Libraries
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <sstream>
+#include "IO.hpp"
+#include "Batch.hpp"
+
+using namespace std;
+
+/**
+ * @brief Measurements of one benchmark case, the fastest of its runs
+ * @param inputPath Input image path
+ * @param errorMessage Error message, empty if the case ran
+ * @param width Width of the image in pixels
+ * @param height Height of the image in pixels
+ * @param channels Number of color channels of the image
+ * @param mode Error calculation mode (1-5)
+ * @param threshold Error threshold, 0 for a target case
+ * @param targetPercentage Target compression percentage, 0 for a threshold case
+ * @param loadMs Wall-clock time of decoding the image and calibrating its JPG quality
+ * @param buildMs Wall-clock time until the quadtree was complete, including the threshold search of a target case
+ * @param outputMs Wall-clock time of writing the output and measuring its size
+ * @param totalMs Wall-clock time of the whole case
+ * @param nodes Number of nodes in the quadtree
+ * @param depth Maximum depth of the quadtree
+ * @param initialSize Input file size in bytes
+ * @param finalSize Compressed image size in bytes
+ * @param compressionPercentage Achieved compression percentage
+ * @param peakMemoryKB Peak resident memory of the case in kilobytes, of the process so far where it cannot be reset
+ */
+struct BenchmarkResult {
+    string inputPath, errorMessage;
+    int width = 0, height = 0, channels = 0, mode = 0;
+    double threshold = 0, targetPercentage = 0;
+    double loadMs = 0, buildMs = 0, outputMs = 0, totalMs = 0;
+    int nodes = 0, depth = 0;
+    size_t initialSize = 0, finalSize = 0;
+    double compressionPercentage = 0;
+    long long peakMemoryKB = 0;
+
+    /**
+     * @brief Get the quadtree nodes built per second
+     * @return Nodes per second of the build time
+     */
+    double getNodesPerSecond() const {
+        return buildMs > 0 ? nodes / (buildMs / 1000.0) : 0;
+    }
+
+    /**
+     * @brief Get the throughput in megabytes of decoded pixels per second
+     * @return Decoded megabytes per second of the whole case
+     */
+    double getMegabytesPerSecond() const {
+        return totalMs > 0 ? ((double)width * height * channels / (1024.0 * 1024.0)) / (totalMs / 1000.0) : 0;
+    }
+};
+
+/**
+ * @brief Runs every error mode at several thresholds, and the target search, over a set of images, timing each phase
+ *        Every case loads its image again, so the load time of a JPG includes the quality calibration only the first time, as in a batch
+ * @param THRESHOLDS Thresholds of every mode, low to high
+ * @param TARGET Target compression percentage of the target case of every mode
+ * @param minBlock Minimum block size in pixels
+ * @param threads Number of threads building the quadtree
+ * @param repeat Runs of every case, the fastest is kept
+ * @param lowMemory Whether every image is compressed in low-memory mode
+ * @param peakReset Whether the peak memory was measured per case
+ * @param results Results of every case, image by image
+ */
+class BenchmarkRunner {
+
+    public:
+        static constexpr double THRESHOLDS[5][3] = {
+            {25, 100, 400},
+            {3, 8, 20},
+            {20, 50, 100},
+            {2, 4, 6},
+            {0.05, 0.2, 0.5}
+        };
+        static constexpr double TARGET = 0.5;
+
+    private:
+        int minBlock, threads, repeat;
+        bool lowMemory, peakReset;
+        vector<BenchmarkResult> results;
+
+        /**
+         * @brief Quote a CSV field if it holds a separator or a quote
+         * @param field Field value
+         * @return Field as written in the CSV
+         */
+        static string csvField(const string& field) {
+            if (field.find_first_of(",\"\n") == string::npos) return field;
+
+            string quoted = "\"";
+            for (char c : field) quoted += c == '"' ? string("\"\"") : string(1, c);
+            return quoted + "\"";
+        }
+
+        /**
+         * @brief Escape a string for a JSON document
+         * @param value String value
+         * @return Quoted JSON string
+         */
+        static string jsonString(const string& value) {
+            string escaped = "\"";
+            for (char c : value) {
+                if (c == '"' || c == '\\') escaped += '\\';
+                if ((unsigned char)c < 0x20) {
+                    char code[8];
+                    snprintf(code, sizeof(code), "\\u%04x", c);
+                    escaped += code;
+                }
+                else escaped += c;
+            }
+            return escaped + "\"";
+        }
+
+        /**
+         * @brief Run one case once, loading the image, compressing it, and writing its output
+         * @param inputPath Input image path
+         * @param outputPath Output image path
+         * @param mode Error calculation mode
+         * @param threshold Error threshold, ignored by a target case
+         * @param targetPercentage Target compression percentage, 0 for a threshold case
+         * @return Measurements of the run
+         */
+        BenchmarkResult runOnce(const string& inputPath, const string& outputPath, int mode, double threshold, double targetPercentage) {
+            BenchmarkResult result;
+            result.inputPath = inputPath;
+            result.mode = mode;
+            result.threshold = targetPercentage == 0 ? threshold : 0;
+            result.targetPercentage = targetPercentage;
+
+            string extension = std::filesystem::path(inputPath).extension().string();
+            if (!extension.empty()) extension = extension.substr(1);
+
+            peakReset = IOHandler::resetPeakMemory();
+            auto start = chrono::steady_clock::now();
+
+            ImageContext ctx;
+            ctx.lowMemory = lowMemory;
+            string errorMsg = Image::loadImage(ctx, inputPath, extension);
+            if (errorMsg.empty() && (long long)minBlock > (long long)ctx.imgWidth * ctx.imgHeight) {
+                errorMsg = "Minimum block size lebih dari luas image.";
+            }
+            if (!errorMsg.empty()) {
+                result.errorMessage = errorMsg;
+                return result;
+            }
+
+            result.width = ctx.imgWidth;
+            result.height = ctx.imgHeight;
+            result.channels = ctx.imgChannels;
+            result.loadMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+            {
+                QuadTree qt(ctx, inputPath, mode, threshold, minBlock, targetPercentage, outputPath, "", extension);
+                qt.setThreads(threads);
+
+                if (targetPercentage == 0) qt.performQuadTree();
+                else qt.performBinserQuadTree(targetPercentage);
+
+                if (!qt.getErrorMessage().empty()) {
+                    result.errorMessage = qt.getErrorMessage();
+                    return result;
+                }
+
+                result.buildMs = qt.getBuildTime();
+                result.outputMs = qt.getOutputTime();
+                result.nodes = qt.getQuadtreeNode();
+                result.depth = qt.getQuadtreeDepth();
+                result.initialSize = qt.getInitialSize();
+                result.finalSize = qt.getFinalSize();
+                result.compressionPercentage = qt.getCompressionPercentage();
+            }
+
+            result.totalMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            result.peakMemoryKB = IOHandler::getPeakMemoryKB();
+            return result;
+        }
+
+    public:
+        /**
+         * @brief Constructor that sets the parameters shared by every case
+         * @param minBlock Minimum block size
+         * @param threads Number of quadtree build threads, 0 to use every hardware thread
+         * @param repeat Runs of every case
+         */
+        BenchmarkRunner(int minBlock, int threads, int repeat) {
+            this -> minBlock = minBlock;
+            this -> threads = threads > 0 ? threads : max(1u, thread::hardware_concurrency());
+            this -> repeat = max(1, repeat);
+            this -> lowMemory = false;
+            this -> peakReset = false;
+        }
+
+        /**
+         * @brief Choose whether every case keeps only its decoded buffer and the smallest error tables
+         * @param lowMemory Compress in low-memory mode
+         */
+        void setLowMemory(bool lowMemory) {
+            this -> lowMemory = lowMemory;
+        }
+
+        /**
+         * @brief Run every case over the images of a directory or manifest, one case at a time so the timings do not interfere
+         * @param source Directory of images, or manifest with one "input[<TAB>output]" entry per line, the outputs are ignored
+         * @param outputDir Directory the outputs of the cases are written to
+         * @param progress Stream that gets a line per finished case, nullptr for none
+         * @return Empty string if the images were found, error message if not
+         */
+        string run(const string& source, const string& outputDir, ostream* progress = nullptr) {
+            results.clear();
+            vector<pair<string, string>> entries;
+
+            string errorMsg = BatchCompressor::readEntries(source, entries);
+            if (!errorMsg.empty()) return errorMsg;
+
+            std::error_code error;
+            std::filesystem::create_directories(outputDir, error);
+
+            size_t total = entries.size() * 5 * 4, done = 0;
+            for (const auto& entry : entries) {
+                string outputPath = (std::filesystem::path(outputDir) / std::filesystem::path(entry.first).filename()).string();
+
+                for (int mode = 1; mode <= 5; mode++) {
+                    for (int k = 0; k <= 3; k++) {
+                        double threshold = k < 3 ? THRESHOLDS[mode - 1][k] : 0;
+                        double targetPercentage = k < 3 ? 0 : TARGET;
+
+                        BenchmarkResult best;
+                        for (int run = 0; run < repeat; run++) {
+                            BenchmarkResult result = runOnce(entry.first, outputPath, mode, threshold, targetPercentage);
+                            if (run == 0 || !result.errorMessage.empty() || result.totalMs < best.totalMs) best = result;
+                            if (!result.errorMessage.empty()) break;
+                        }
+                        results.push_back(best);
+
+                        if (progress != nullptr) {
+                            *progress << "[" << ++done << "/" << total << "] " << entry.first << " mode " << mode;
+                            if (targetPercentage == 0) *progress << " threshold " << threshold;
+                            else *progress << " target " << targetPercentage;
+                            *progress << ": " << (best.errorMessage.empty() ? to_string((int)best.totalMs) + " ms" : best.errorMessage) << endl;
+                        }
+                    }
+                }
+            }
+
+            return "";
+        }
+
+        /**
+         * @brief Write the results as CSV, one header line and one line per case
+         * @param out Output stream
+         */
+        void writeCsv(ostream& out) const {
+            out << "image,width,height,channels,mode,threshold,target,load_ms,build_ms,output_ms,total_ms,nodes,depth,"
+                << "nodes_per_sec,mb_per_sec,initial_size,final_size,compression_percentage,peak_rss_kb,error" << endl;
+
+            out << fixed << setprecision(3);
+            for (const auto& r : results) {
+                out << csvField(r.inputPath) << "," << r.width << "," << r.height << "," << r.channels << "," << r.mode << ","
+                    << r.threshold << "," << r.targetPercentage << "," << r.loadMs << "," << r.buildMs << "," << r.outputMs << "," << r.totalMs << ","
+                    << r.nodes << "," << r.depth << "," << r.getNodesPerSecond() << "," << r.getMegabytesPerSecond() << ","
+                    << r.initialSize << "," << r.finalSize << "," << r.compressionPercentage << "," << r.peakMemoryKB << ","
+                    << csvField(r.errorMessage) << endl;
+            }
+            out << defaultfloat;
+        }
+
+        /**
+         * @brief Write the run parameters and the results as one JSON document
+         * @param out Output stream
+         */
+        void writeJson(ostream& out) const {
+            out << fixed << setprecision(3);
+            out << "{" << endl;
+            out << "  \"min_block\": " << minBlock << "," << endl;
+            out << "  \"threads\": " << threads << "," << endl;
+            out << "  \"repeat\": " << repeat << "," << endl;
+            out << "  \"low_memory\": " << (lowMemory ? "true" : "false") << "," << endl;
+            out << "  \"peak_rss_per_case\": " << (peakReset ? "true" : "false") << "," << endl;
+            out << "  \"cases\": [";
+
+            for (size_t i = 0; i < results.size(); i++) {
+                const BenchmarkResult& r = results[i];
+                out << (i == 0 ? "" : ",") << endl << "    {";
+                out << "\"image\": " << jsonString(r.inputPath) << ", \"width\": " << r.width << ", \"height\": " << r.height
+                    << ", \"channels\": " << r.channels << ", \"mode\": " << r.mode << ", \"threshold\": " << r.threshold
+                    << ", \"target\": " << r.targetPercentage << ", \"load_ms\": " << r.loadMs << ", \"build_ms\": " << r.buildMs
+                    << ", \"output_ms\": " << r.outputMs << ", \"total_ms\": " << r.totalMs << ", \"nodes\": " << r.nodes
+                    << ", \"depth\": " << r.depth << ", \"nodes_per_sec\": " << r.getNodesPerSecond()
+                    << ", \"mb_per_sec\": " << r.getMegabytesPerSecond() << ", \"initial_size\": " << r.initialSize
+                    << ", \"final_size\": " << r.finalSize << ", \"compression_percentage\": " << r.compressionPercentage
+                    << ", \"peak_rss_kb\": " << r.peakMemoryKB << ", \"error\": " << jsonString(r.errorMessage) << "}";
+            }
+
+            out << endl << "  ]" << endl << "}" << endl;
+            out << defaultfloat;
+        }
+
+        /**
+         * @brief Get the results of every case
+         * @return Results, image by image, each image mode by mode
+         */
+        const vector<BenchmarkResult>& getResults() const {return results;}
+
+        /**
+         * @brief Get the number of cases that failed
+         * @return Failed case count
+         */
+        int getFailedCount() const {
+            int failed = 0;
+            for (const auto& result : results) if (!result.errorMessage.empty()) failed++;
+            return failed;
+        }
+};
+
+#endif
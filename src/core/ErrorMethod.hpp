@@ -3,68 +3,64 @@
 
 // Libraries
 #include "Image.hpp"
-#include <unordered_map>
-
-/**
- * @brief Image data buffers used throughout the compression process
- * @param currImgData Current image data buffer used for processing
- * @param initImgData Initial image data buffer kept as reference
- * @param tempImgData Temporary image data buffer for intermediate processing
- */
-extern unsigned char* currImgData, *initImgData, *tempImgData;
-
-/**
- * @brief Global image dimensions and format information
- * @param imgWidth Width of the image in pixels
- * @param imgHeight Height of the image in pixels
- * @param imgChannels Number of color channels (typically 3 for RGB, 4 for RGBA)
- */
-extern int imgWidth, imgHeight, imgChannels;
+#include "RegionKernels.hpp"
 
 /**
  * @brief Abstract base class for different error calculation methods
  * @param upperThreshold Upper limit for error value
  * @param lowerThreshold Lower limit for error value
- * @param avgR Average red channel value for the region
- * @param avgG Average green channel value for the region
- * @param avgB Average blue channel value for the region
+ * @param imgWidth Width of the image in pixels
+ * @param imgHeight Height of the image in pixels
+ * @param imgChannels Number of color channels of the image
  */
 class ErrorMethod {
 
     protected:  
         double upperThreshold;
         double lowerThreshold;
-        double avgR, avgG, avgB;
+        int imgWidth, imgHeight, imgChannels;
 
     public:
+        /**
+         * @brief Constructor that takes the image dimensions from the context
+         * @param ctx Image context of the compressed image
+         */
+        ErrorMethod(const ImageContext& ctx) {
+            imgWidth = ctx.imgWidth;
+            imgHeight = ctx.imgHeight;
+            imgChannels = ctx.imgChannels;
+        }
+
+        /**
+         * @brief Virtual destructor so derived classes release their tables
+         */
+        virtual ~ErrorMethod() {}
+
         /**
          * @brief Calculate error for a specific region of an image, overridden by derived classes
+         *        Keeps no per-region state, so regions can be measured from several threads at once
          * @param currImgData Pointer to image data
          * @param x Starting x-coordinate
          * @param y Starting y-coordinate
          * @param width Width of the region
          * @param height Height of the region
+         * @param avgR Output average red value of the region
+         * @param avgG Output average green value of the region
+         * @param avgB Output average blue value of the region
          * @return Error value calculated for the region using the specific method (derived class)
          */
-        virtual double calculateError(unsigned char* currImgData, int x, int y, int width, int height) = 0;
-        
-        /**
-         * @brief Get the average red value of the last processed region
-         * @return Average red channel value
-         */
-        double getAvgR() const { return avgR; }
-
-        /**
-         * @brief Get the average green value of the last processed region
-         * @return Average green channel value
-         */
-        double getAvgG() const { return avgG; }
+        virtual double calculateError(const unsigned char* currImgData, int x, int y, int width, int height, double& avgR, double& avgG, double& avgB) const = 0;
 
         /**
-         * @brief Get the average blue value of the last processed region
-         * @return Average blue channel value
+         * @brief Get the number of pixels calculateError reads one by one for a region, the rest is answered from the tables
+         *        Only asked for when stats are collected, methods answering every region from their tables keep the default
+         * @param x Starting x-coordinate
+         * @param y Starting y-coordinate
+         * @param width Width of the region
+         * @param height Height of the region
+         * @return Scanned pixel count, 0 or the area of the region
          */
-        double getAvgB() const { return avgB; }
+        virtual long long getScannedPixels(int, int, int, int) const { return 0; }
 
         /**
          * @brief Get the upper threshold for this error method
@@ -77,126 +73,288 @@ class ErrorMethod {
          * @return Lower threshold value
          */
         double getLowerThreshold() const { return lowerThreshold; }
+
+        /**
+         * @brief Get the threshold range of an error method without building its lookup tables
+         * @param mode Error calculation mode (1-5)
+         * @param lower Output lower threshold
+         * @param upper Output upper threshold
+         */
+        static void getThresholdRange(int mode, double& lower, double& upper);
+
+        /**
+         * @brief Build the error method of a mode for an image
+         * @param mode Error calculation mode (1-5)
+         * @param ctx Image context whose current image data is measured
+         * @return New error method, owned by the caller
+         */
+        static ErrorMethod* create(int mode, const ImageContext& ctx);
+
+        /**
+         * @brief Measure a region from its value histogram, with the same error and average the method gives for its pixels
+         *        Lets a region be measured from the merged histograms of its parts, without the pixels or tables of the whole image
+         * @param mode Error calculation mode (1-5)
+         * @param hist Histogram of 3 * HistogramTree::BINS counts, red then green then blue
+         * @param n Number of pixels of the region
+         * @param avgR Output average red value of the region
+         * @param avgG Output average green value of the region
+         * @param avgB Output average blue value of the region
+         * @return Error value of the region
+         */
+        static double histogramError(int mode, const unsigned long long* hist, long long n, double& avgR, double& avgG, double& avgB);
 };
 
 /**
- * @brief Implements error calculation using variance of pixel values
- * @param prefsumR 2D array for red channel prefix sum
- * @param prefsumG 2D array for green channel prefix sum
- * @param prefsumB 2D array for blue channel prefix sum
- * @param prefsumR2 2D array for squared red channel prefix sum
- * @param prefsumG2 2D array for squared green channel prefix sum
- * @param prefsumB2 2D array for squared blue channel prefix sum
+ * @brief Padded integral image of the RGB channels and of their squares, for constant-time region sums
+ *        One contiguous table of (height + 1) x (width + 1) entries with a zero first row and column, so a query needs no edge cases,
+ *        and every entry keeps the sums and squared sums of all channels together, so a query reads only its four corner entries
+ *        The tiled layout keeps the table in TILE x TILE tiles instead, each pixel holding 32-bit sums of its own tile only,
+ *        with 64-bit sums at the tile corners and along the tile edges, for about half the memory and the same exact sums
+ * @param TILE Side of a tile of the tiled layout in pixels, a power of two
+ * @param TILE_BITS Shift of a row or column to its tile
+ * @param table Integral image entries, row-major
+ * @param stride Number of entries in a row of the table, width + 1
+ * @param rows Number of rows of the table, height + 1
+ * @param tiled Whether the tiled layout is used
+ * @param local Sums of each pixel from the corner of its tile, inclusive, row-major
+ * @param corners Entries at the tile corners, tileStride per tile row
+ * @param rowEdges Sums from the first row of the tile row to each row, left of each tile column, tileStride per row
+ * @param colEdges Sums above each tile row, from the first column of the tile column to each column, stride per tile row
+ * @param width Width of the image in pixels
+ * @param tileStride Number of tile columns plus one
  */
-class Variance : public ErrorMethod {
-    
-    private:
-        long long** prefsumR;
-        long long** prefsumG;
-        long long** prefsumB;
-        long long** prefsumR2;
-        long long** prefsumG2;
-        long long** prefsumB2;
+class IntegralImage {
 
     public:
+        static constexpr int TILE_BITS = 6;
+        static constexpr int TILE = 1 << TILE_BITS;
+
+        struct Entry {
+            long long sum[3];
+            long long sq[3];
+        };
+
+        struct LocalEntry {
+            uint32_t sum[3];
+            uint32_t sq[3];
+        };
+
+    private:
+        Entry* table;
+        int stride, rows;
+
+        bool tiled;
+        vector<LocalEntry> local;
+        vector<Entry> corners, rowEdges, colEdges;
+        int width, tileStride;
+
         /**
-         * @brief Default Constructor that initializes prefix sum arrays
+         * @brief Build the tiled layout row by row from one row of the full integral image at a time
+         * @param image Pointer to image data
+         * @param height Height of the image in pixels
+         * @param channels Number of color channels of the image
          */
-        Variance() {
+        void buildTiled(const unsigned char* image, int height, int channels) {
+            int tileRows = (height >> TILE_BITS) + 1;
+            local.resize((size_t)width * height);
+            corners.resize((size_t)tileRows * tileStride);
+            rowEdges.resize((size_t)rows * tileStride);
+            colEdges.resize((size_t)tileRows * stride);
 
-            // Default values for upper and lower thresholds in Variance method
-            upperThreshold = 127.5 * 127.5;
-            lowerThreshold = 0;
+            vector<Entry> prefix(stride, Entry{});
+            for (int r = 0; r <= height; r++) {
+                // prefix is the full integral image row r, so the tables of row r are differences of it
+                if ((r & (TILE - 1)) == 0) {
+                    int R = r >> TILE_BITS;
+                    for (int C = 0; C < tileStride; C++) corners[(size_t)R * tileStride + C] = prefix[min(C << TILE_BITS, width)];
+                    for (int c = 0; c < stride; c++) {
+                        const Entry& corner = prefix[c & ~(TILE - 1)];
+                        for (int k = 0; k < 3; k++) {
+                            colEdges[(size_t)R * stride + c].sum[k] = prefix[c].sum[k] - corner.sum[k];
+                            colEdges[(size_t)R * stride + c].sq[k] = prefix[c].sq[k] - corner.sq[k];
+                        }
+                    }
+                }
 
-            // Initialize prefix sum arrays
-            prefsumR = new long long*[imgHeight];
-            prefsumG = new long long*[imgHeight];
-            prefsumB = new long long*[imgHeight];
-            prefsumR2 = new long long*[imgHeight];
-            prefsumG2 = new long long*[imgHeight];
-            prefsumB2 = new long long*[imgHeight];
-            
-            // Allocate memory for each row of the prefix sum arrays
-            for (int i = 0; i < imgHeight; ++i) {
-                prefsumR[i] = new long long[imgWidth];
-                prefsumG[i] = new long long[imgWidth];
-                prefsumB[i] = new long long[imgWidth];
-                prefsumR2[i] = new long long[imgWidth];
-                prefsumG2[i] = new long long[imgWidth];
-                prefsumB2[i] = new long long[imgWidth];
-            }
-
-            // Calculate prefix sums for the image data
-            for (int i = 0; i < imgHeight; i++) {
-                for (int j = 0; j < imgWidth; j++) {
-        
-                    int idx = (i * imgWidth + j) * imgChannels;
-                   
-                    // Initialize prefix sum arrays with pixel values
-                    prefsumR[i][j] = currImgData[idx + 0];
-                    prefsumG[i][j] = currImgData[idx + 1];
-                    prefsumB[i][j] = currImgData[idx + 2];
-                    prefsumR2[i][j] = currImgData[idx + 0] * currImgData[idx + 0];
-                    prefsumG2[i][j] = currImgData[idx + 1] * currImgData[idx + 1];
-                    prefsumB2[i][j] = currImgData[idx + 2] * currImgData[idx + 2];
-                    
-                    // For the top-left pixel, no need to add anything
-                    if (i == 0 && j == 0) {
-                        continue;
+                const Entry* corner = &corners[(size_t)(r >> TILE_BITS) * tileStride];
+                for (int C = 0; C < tileStride; C++) {
+                    const Entry& full = prefix[min(C << TILE_BITS, width)];
+                    for (int k = 0; k < 3; k++) {
+                        rowEdges[(size_t)r * tileStride + C].sum[k] = full.sum[k] - corner[C].sum[k];
+                        rowEdges[(size_t)r * tileStride + C].sq[k] = full.sq[k] - corner[C].sq[k];
                     }
+                }
+
+                if (r == height) break;
 
-                    // For the first row, add the previous pixel value
-                    else if (i == 0) {
-                        prefsumR[i][j] += prefsumR[i][j - 1];
-                        prefsumG[i][j] += prefsumG[i][j - 1];
-                        prefsumB[i][j] += prefsumB[i][j - 1];
-                        prefsumR2[i][j] += prefsumR2[i][j - 1];
-                        prefsumG2[i][j] += prefsumG2[i][j - 1];
-                        prefsumB2[i][j] += prefsumB2[i][j - 1];
+                // Local sums of row r from the row above in the same tile, and the next full row
+                const unsigned char* pixel = image + (size_t)r * width * channels;
+                LocalEntry* row = &local[(size_t)r * width];
+                const LocalEntry* above = (r & (TILE - 1)) ? row - width : nullptr;
+                long long rowSum[3] = {0, 0, 0}, rowSq[3] = {0, 0, 0};
+                uint32_t tileSum[3] = {0, 0, 0}, tileSq[3] = {0, 0, 0};
+
+                for (int c = 0; c < width; c++, pixel += channels) {
+                    if ((c & (TILE - 1)) == 0) {
+                        for (int k = 0; k < 3; k++) tileSum[k] = tileSq[k] = 0;
                     }
 
-                    // For the first column, add the previous pixel value
-                    else if (j == 0) {
-                        prefsumR[i][j] += prefsumR[i - 1][j];
-                        prefsumG[i][j] += prefsumG[i - 1][j];
-                        prefsumB[i][j] += prefsumB[i - 1][j];
-                        prefsumR2[i][j] += prefsumR2[i - 1][j];
-                        prefsumG2[i][j] += prefsumG2[i - 1][j];
-                        prefsumB2[i][j] += prefsumB2[i - 1][j];
+                    for (int k = 0; k < 3; k++) {
+                        uint32_t value = pixel[k];
+                        tileSum[k] += value;
+                        tileSq[k] += value * value;
+                        row[c].sum[k] = tileSum[k] + (above ? above[c].sum[k] : 0);
+                        row[c].sq[k] = tileSq[k] + (above ? above[c].sq[k] : 0);
+
+                        rowSum[k] += value;
+                        rowSq[k] += value * value;
+                        prefix[c + 1].sum[k] += rowSum[k];
+                        prefix[c + 1].sq[k] += rowSq[k];
                     }
+                }
+            }
+        }
+
+        /**
+         * @brief Get an entry of the full integral image from the tiled layout
+         * @param r Row of the entry, 0 to height
+         * @param c Column of the entry, 0 to width
+         * @param sum Output sum of each channel above and left of the entry
+         * @param sq Output sum of the squares of each channel above and left of the entry
+         */
+        void tiledEntry(int r, int c, long long sum[3], long long sq[3]) const {
+            int R = r >> TILE_BITS, C = c >> TILE_BITS;
+            const Entry& corner = corners[(size_t)R * tileStride + C];
+            const Entry& rowEdge = rowEdges[(size_t)r * tileStride + C];
+            const Entry& colEdge = colEdges[(size_t)R * stride + c];
+
+            for (int k = 0; k < 3; k++) {
+                sum[k] = corner.sum[k] + rowEdge.sum[k] + colEdge.sum[k];
+                sq[k] = corner.sq[k] + rowEdge.sq[k] + colEdge.sq[k];
+            }
+
+            if ((r & (TILE - 1)) && (c & (TILE - 1))) {
+                const LocalEntry& inside = local[(size_t)(r - 1) * width + c - 1];
+                for (int k = 0; k < 3; k++) {
+                    sum[k] += inside.sum[k];
+                    sq[k] += inside.sq[k];
+                }
+            }
+        }
+
+    public:
+        /**
+         * @brief Constructor that builds the table row by row from running row sums
+         * @param image Pointer to image data
+         * @param width Width of the image in pixels
+         * @param height Height of the image in pixels
+         * @param channels Number of color channels of the image
+         * @param tiled Whether the tiled layout is used, for about half the memory and slower queries
+         */
+        IntegralImage(const unsigned char* image, int width, int height, int channels, bool tiled = false) {
+            this -> stride = width + 1;
+            this -> rows = height + 1;
+            this -> tiled = tiled;
+            this -> width = width;
+            this -> tileStride = (width >> TILE_BITS) + 1;
+            this -> table = nullptr;
+
+            if (tiled) {
+                buildTiled(image, height, channels);
+                return;
+            }
+
+            table = new Entry[(size_t)stride * rows];
 
-                    // For all other pixels, add the values from the left and top pixels
-                    else {
-                        prefsumR[i][j] += prefsumR[i - 1][j] + prefsumR[i][j - 1] - prefsumR[i - 1][j - 1];
-                        prefsumG[i][j] += prefsumG[i - 1][j] + prefsumG[i][j - 1] - prefsumG[i - 1][j - 1];
-                        prefsumB[i][j] += prefsumB[i - 1][j] + prefsumB[i][j - 1] - prefsumB[i - 1][j - 1];
-                        prefsumR2[i][j] += prefsumR2[i - 1][j] + prefsumR2[i][j - 1] - prefsumR2[i - 1][j - 1];
-                        prefsumG2[i][j] += prefsumG2[i - 1][j] + prefsumG2[i][j - 1] - prefsumG2[i - 1][j - 1];
-                        prefsumB2[i][j] += prefsumB2[i - 1][j] + prefsumB2[i][j - 1] - prefsumB2[i - 1][j - 1];
+            for (int j = 0; j < stride; j++) table[j] = Entry{};
+
+            for (int i = 0; i < height; i++) {
+                const Entry* above = table + (size_t)i * stride;
+                Entry* row = table + (size_t)(i + 1) * stride;
+                const unsigned char* pixel = image + (size_t)i * width * channels;
+                long long rowSum[3] = {0, 0, 0}, rowSq[3] = {0, 0, 0};
+
+                row[0] = Entry{};
+                for (int j = 0; j < width; j++, pixel += channels) {
+                    for (int c = 0; c < 3; c++) {
+                        long long value = pixel[c];
+                        rowSum[c] += value;
+                        rowSq[c] += value * value;
+                        row[j + 1].sum[c] = above[j + 1].sum[c] + rowSum[c];
+                        row[j + 1].sq[c] = above[j + 1].sq[c] + rowSq[c];
                     }
                 }
             }
         }
 
+        IntegralImage(const IntegralImage&) = delete;
+        IntegralImage& operator=(const IntegralImage&) = delete;
+
         /**
-         * @brief Destructor that cleans up allocated prefix sum arrays
+         * @brief Destructor that frees the table
          */
-        ~Variance() {
-            for (int i = 0; i < imgHeight; ++i) {
-                delete[] prefsumR[i];
-                delete[] prefsumG[i];
-                delete[] prefsumB[i];
-                delete[] prefsumR2[i];
-                delete[] prefsumG2[i];
-                delete[] prefsumB2[i];
+        ~IntegralImage() {
+            delete[] table;
+        }
+
+        /**
+         * @brief Sum the channels and their squares over a region
+         * @param row Starting row
+         * @param col Starting column
+         * @param width Width of the region
+         * @param height Height of the region
+         * @param sum Output sum of each channel
+         * @param sq Output sum of the squares of each channel
+         */
+        void query(int row, int col, int width, int height, long long sum[3], long long sq[3]) const {
+            if (tiled) {
+                long long corner[4][2][3];
+                tiledEntry(row, col, corner[0][0], corner[0][1]);
+                tiledEntry(row, col + width, corner[1][0], corner[1][1]);
+                tiledEntry(row + height, col, corner[2][0], corner[2][1]);
+                tiledEntry(row + height, col + width, corner[3][0], corner[3][1]);
+
+                for (int c = 0; c < 3; c++) {
+                    sum[c] = corner[3][0][c] - corner[1][0][c] - corner[2][0][c] + corner[0][0][c];
+                    sq[c] = corner[3][1][c] - corner[1][1][c] - corner[2][1][c] + corner[0][1][c];
+                }
+                return;
             }
 
-            delete[] prefsumR;
-            delete[] prefsumG;
-            delete[] prefsumB;
-            delete[] prefsumR2;
-            delete[] prefsumG2;
-            delete[] prefsumB2;
+            const Entry& topLeft = table[(size_t)row * stride + col];
+            const Entry& topRight = table[(size_t)row * stride + col + width];
+            const Entry& bottomLeft = table[(size_t)(row + height) * stride + col];
+            const Entry& bottomRight = table[(size_t)(row + height) * stride + col + width];
+
+            for (int c = 0; c < 3; c++) {
+                sum[c] = bottomRight.sum[c] - topRight.sum[c] - bottomLeft.sum[c] + topLeft.sum[c];
+                sq[c] = bottomRight.sq[c] - topRight.sq[c] - bottomLeft.sq[c] + topLeft.sq[c];
+            }
+        }
+};
+
+/**
+ * @brief Implements error calculation using variance of pixel values
+ * @param UPPER_THRESHOLD Maximum variance of an 8-bit channel, 127.5^2
+ * @param integral Integral image of the channels and their squares
+ */
+class Variance : public ErrorMethod {
+    
+    private:
+        IntegralImage integral;
+
+    public:
+        static constexpr double UPPER_THRESHOLD = 127.5 * 127.5;
+
+        /**
+         * @brief Constructor that builds the integral image
+         * @param ctx Image context whose current image data is measured
+         */
+        Variance(const ImageContext& ctx) : ErrorMethod(ctx), integral(ctx.currImgData, ctx.imgWidth, ctx.imgHeight, ctx.imgChannels, ctx.lowMemory) {
+
+            // Default values for upper and lower thresholds in Variance method
+            upperThreshold = UPPER_THRESHOLD;
+            lowerThreshold = 0;
         }
         
         /**
@@ -206,88 +364,225 @@ class Variance : public ErrorMethod {
          * @param col Starting column
          * @param width Width of the region
          * @param height Height of the region
+         * @param avgR Output average red value of the region
+         * @param avgG Output average green value of the region
+         * @param avgB Output average blue value of the region
          * @return Average variance across RGB channels
          */
-        double calculateError(unsigned char* currImgData, int row, int col, int width, int height) override {
-            long long sumR, sumG, sumB;
-            long long sumR2, sumG2, sumB2;
+        double calculateError([[maybe_unused]] const unsigned char* currImgData, int row, int col, int width, int height, double& avgR, double& avgG, double& avgB) const override {
+            long long sum[3], sq[3];
 
             // If the width or height is zero, return 0 to avoid division by zero (or invalid area)
             if (width == 0 || height == 0) {
                 return 0;
             }
             
-            // Top-left corner, use the prefix sum directly
-            if (row == 0 && col == 0) {
-                sumR = prefsumR[row + height - 1][col + width - 1];
-                sumG = prefsumG[row + height - 1][col + width - 1];
-                sumB = prefsumB[row + height - 1][col + width - 1];
+            integral.query(row, col, width, height, sum, sq);
 
-                sumR2 = prefsumR2[row + height - 1][col + width - 1];
-                sumG2 = prefsumG2[row + height - 1][col + width - 1];
-                sumB2 = prefsumB2[row + height - 1][col + width - 1];
-            }
+            // Calculate average values for each channel
+            double n = width * height;
+            avgR = sum[0] / n;
+            avgG = sum[1] / n;
+            avgB = sum[2] / n;
 
-            // First row
-            else if (row == 0) {
-                sumR = prefsumR[row + height - 1][col + width - 1] - prefsumR[row + height - 1][col - 1];
-                sumG = prefsumG[row + height - 1][col + width - 1] - prefsumG[row + height - 1][col - 1];
-                sumB = prefsumB[row + height - 1][col + width - 1] - prefsumB[row + height - 1][col - 1];
+            // Calculate variance for each channel
+            double varianceR = (sq[0] / n) - (avgR * avgR);
+            double varianceG = (sq[1] / n) - (avgG * avgG);
+            double varianceB = (sq[2] / n) - (avgB * avgB);
 
-                sumR2 = prefsumR2[row + height - 1][col + width - 1] - prefsumR2[row + height - 1][col - 1];
-                sumG2 = prefsumG2[row + height - 1][col + width - 1] - prefsumG2[row + height - 1][col - 1];
-                sumB2 = prefsumB2[row + height - 1][col + width - 1] - prefsumB2[row + height - 1][col - 1];
+            // Calculate the final error value as the average of variances across all channels
+            return (varianceR + varianceG + varianceB) / 3.0;
+        }
+
+        /**
+         * @brief Calculate variance from the histogram of a region, the sums are the exact ones of the integral image
+         * @param hist Histogram of 3 * 256 counts, red then green then blue
+         * @param count Number of pixels of the region
+         * @param avgR Output average red value of the region
+         * @param avgG Output average green value of the region
+         * @param avgB Output average blue value of the region
+         * @return Average variance across RGB channels
+         */
+        static double measureHistogram(const unsigned long long* hist, long long count, double& avgR, double& avgG, double& avgB) {
+            if (count == 0) {
+                return 0;
             }
 
-            // First column
-            else if (col == 0) {
-                sumR = prefsumR[row + height - 1][col + width - 1] - prefsumR[row - 1][col + width - 1];
-                sumG = prefsumG[row + height - 1][col + width - 1] - prefsumG[row - 1][col + width - 1];
-                sumB = prefsumB[row + height - 1][col + width - 1] - prefsumB[row - 1][col + width - 1];
+            long long sum[3] = {0, 0, 0}, sq[3] = {0, 0, 0};
+            for (int c = 0; c < 3; c++) {
+                for (int v = 0; v < 256; v++) {
+                    sum[c] += (long long)hist[c * 256 + v] * v;
+                    sq[c] += (long long)hist[c * 256 + v] * v * v;
+                }
+            }
+
+            double n = count;
+            avgR = sum[0] / n;
+            avgG = sum[1] / n;
+            avgB = sum[2] / n;
+
+            double varianceR = (sq[0] / n) - (avgR * avgR);
+            double varianceG = (sq[1] / n) - (avgG * avgG);
+            double varianceB = (sq[2] / n) - (avgB * avgB);
+            return (varianceR + varianceG + varianceB) / 3.0;
+        }
+};
+
+/**
+ * @brief Per-channel value histograms of the regions the quadtree splits into, built bottom-up so each pixel is read once
+ *        Nodes follow the quadtree split geometry down to regions of MIN_NODE_AREA pixels, smaller regions are scanned directly
+ * @param MIN_NODE_AREA Smallest region in pixels that keeps a histogram
+ * @param BINS Number of histogram bins of a channel
+ * @param nodes Regions with a histogram, the root first
+ * @param counts Histograms of the nodes, 3 * BINS counts per node
+ * @param image Pointer to image data
+ * @param imgWidth Width of the image in pixels
+ * @param imgChannels Number of color channels of the image
+ */
+class HistogramTree {
+
+    public:
+        static constexpr long long MIN_NODE_AREA = 64 * 64;
+        static constexpr int BINS = 256;
 
-                sumR2 = prefsumR2[row + height - 1][col + width - 1] - prefsumR2[row - 1][col + width - 1];
-                sumG2 = prefsumG2[row + height - 1][col + width - 1] - prefsumG2[row - 1][col + width - 1];
-                sumB2 = prefsumB2[row + height - 1][col + width - 1] - prefsumB2[row - 1][col + width - 1];
+    private:
+        struct Node {
+            int x, y, width, height;
+            int child[4];
+        };
+
+        vector<Node> nodes;
+        vector<unsigned int> counts;
+        const unsigned char* image;
+        int imgWidth, imgChannels;
+
+        /**
+         * @brief Build the node of a region and its subtree, merging the histograms of the children into it
+         * @param x Starting row
+         * @param y Starting column
+         * @param width Width of the region
+         * @param height Height of the region
+         * @return Index of the node
+         */
+        int build(int x, int y, int width, int height) {
+            int index = nodes.size();
+            nodes.push_back({x, y, width, height, {-1, -1, -1, -1}});
+            counts.resize(counts.size() + 3 * BINS, 0);
+
+            int children[4][4] = {
+                {x, y, width / 2, height / 2},
+                {x + height / 2, y, width / 2, height - height / 2},
+                {x, y + width / 2, width - width / 2, height / 2},
+                {x + height / 2, y + width / 2, width - width / 2, height - height / 2}
+            };
+
+            for (int k = 0; k < 4; k++) {
+                int* c = children[k];
+
+                if ((long long)c[2] * c[3] >= MIN_NODE_AREA) {
+                    int child = build(c[0], c[1], c[2], c[3]);
+                    nodes[index].child[k] = child;
+
+                    unsigned int* to = &counts[(size_t)index * 3 * BINS];
+                    const unsigned int* from = &counts[(size_t)child * 3 * BINS];
+                    for (int b = 0; b < 3 * BINS; b++) to[b] += from[b];
+                }
+                else {
+                    addPixels(&counts[(size_t)index * 3 * BINS], image, c[0], c[1], c[2], c[3]);
+                }
             }
 
-            // For all other pixels, use the prefix sum formula
-            else {
-                sumR = prefsumR[row + height - 1][col + width - 1] - prefsumR[row - 1][col + width - 1] - prefsumR[row + height - 1][col - 1] + prefsumR[row - 1][col - 1];
-                sumG = prefsumG[row + height - 1][col + width - 1] - prefsumG[row - 1][col + width - 1] - prefsumG[row + height - 1][col - 1] + prefsumG[row - 1][col - 1];
-                sumB = prefsumB[row + height - 1][col + width - 1] - prefsumB[row - 1][col + width - 1] - prefsumB[row + height - 1][col - 1] + prefsumB[row - 1][col - 1];
+            return index;
+        }
 
-                sumR2 = prefsumR2[row + height - 1][col + width - 1] - prefsumR2[row - 1][col + width - 1] - prefsumR2[row + height - 1][col - 1] + prefsumR2[row - 1][col - 1];
-                sumG2 = prefsumG2[row + height - 1][col + width - 1] - prefsumG2[row - 1][col + width - 1] - prefsumG2[row + height - 1][col - 1] + prefsumG2[row - 1][col - 1];
-                sumB2 = prefsumB2[row + height - 1][col + width - 1] - prefsumB2[row - 1][col + width - 1] - prefsumB2[row + height - 1][col - 1] + prefsumB2[row - 1][col - 1];
+    public:
+        /**
+         * @brief Constructor that builds the whole tree
+         * @param image Pointer to image data
+         * @param imgWidth Width of the image in pixels
+         * @param imgHeight Height of the image in pixels
+         * @param imgChannels Number of color channels of the image
+         */
+        HistogramTree(const unsigned char* image, int imgWidth, int imgHeight, int imgChannels) {
+            this -> image = image;
+            this -> imgWidth = imgWidth;
+            this -> imgChannels = imgChannels;
+            if ((long long)imgWidth * imgHeight >= MIN_NODE_AREA) build(0, 0, imgWidth, imgHeight);
+        }
+
+        /**
+         * @brief Count the pixels of a region into a histogram
+         * @param hist Histogram of 3 * BINS counts, red then green then blue
+         * @param image Pointer to image data
+         * @param x Starting row
+         * @param y Starting column
+         * @param width Width of the region
+         * @param height Height of the region
+         */
+        void addPixels(unsigned int* hist, const unsigned char* image, int x, int y, int width, int height) const {
+            for (int i = x; i < x + height; i++) {
+                const unsigned char* pixel = image + ((size_t)i * imgWidth + y) * imgChannels;
+                for (int j = 0; j < width; j++, pixel += imgChannels) {
+                    hist[pixel[0]]++;
+                    hist[BINS + pixel[1]]++;
+                    hist[2 * BINS + pixel[2]]++;
+                }
             }
+        }
 
-            // Calculate average values for each channel
-            double n = width * height;
-            avgR = sumR / n;
-            avgG = sumG / n;
-            avgB = sumB / n;
+        /**
+         * @brief Find the histogram of a region by descending from the root along the split geometry
+         * @param x Starting row
+         * @param y Starting column
+         * @param width Width of the region
+         * @param height Height of the region
+         * @return Histogram of 3 * BINS counts, nullptr if the region has no node
+         */
+        const unsigned int* find(int x, int y, int width, int height) const {
+            if (nodes.empty() || (long long)width * height < MIN_NODE_AREA) return nullptr;
 
-            // Calculate variance for each channel
-            double varianceR = (sumR2 / n) - (avgR * avgR);
-            double varianceG = (sumG2 / n) - (avgG * avgG);
-            double varianceB = (sumB2 / n) - (avgB * avgB);
+            int index = 0;
+            while (index != -1) {
+                const Node& node = nodes[index];
+                if (node.x == x && node.y == y && node.width == width && node.height == height) {
+                    return &counts[(size_t)index * 3 * BINS];
+                }
 
-            // Calculate the final error value as the average of variances across all channels
-            return (varianceR + varianceG + varianceB) / 3.0;
+                int next = -1;
+                for (int k = 0; k < 4 && next == -1; k++) {
+                    int child = node.child[k];
+                    if (child == -1) continue;
+
+                    const Node& c = nodes[child];
+                    if (x >= c.x && y >= c.y && x + height <= c.x + c.height && y + width <= c.y + c.width) next = child;
+                }
+                index = next;
+            }
+
+            return nullptr;
         }
 };
 
 /**
  * @brief Implements error calculation using mean absolute deviation
+ *        The deviations are summed exactly as integers, sum |n * v - sum| / n^2, from a region histogram or from the pixels
+ * @param UPPER_THRESHOLD Maximum mean absolute deviation of an 8-bit channel
+ * @param histograms Histograms of the large regions
  */
 class MeanAbsoluteDeviation : public ErrorMethod {
 
+    private:
+        HistogramTree histograms;
+
     public:
+        static constexpr double UPPER_THRESHOLD = 127.5;
+
         /**
-         * @brief Default Constructor that sets appropriate thresholds for MAD
+         * @brief Constructor that sets appropriate thresholds for MAD and builds the region histograms
+         * @param ctx Image context whose current image data is measured
          */
-        MeanAbsoluteDeviation() {
-            upperThreshold = 127.5;
+        MeanAbsoluteDeviation(const ImageContext& ctx) : ErrorMethod(ctx), histograms(ctx.currImgData, ctx.imgWidth, ctx.imgHeight, ctx.imgChannels) {
+            upperThreshold = UPPER_THRESHOLD;
             lowerThreshold = 0;
         }
         
@@ -298,67 +593,260 @@ class MeanAbsoluteDeviation : public ErrorMethod {
          * @param y Starting y-coordinate
          * @param width Width of the region
          * @param height Height of the region
+         * @param avgR Output average red value of the region
+         * @param avgG Output average green value of the region
+         * @param avgB Output average blue value of the region
          * @return Average MAD across RGB channels
          */
-        double calculateError(unsigned char* currImgData, int x, int y, int width, int height) override {
-            double sumAbsDevR = 0, sumAbsDevG = 0, sumAbsDevB = 0;
-            double sumR = 0, sumG = 0, sumB = 0;
-            
-            // Calculate average values for each channel
-            for (int i = x; i < x + height; i++) {
-                for (int j = y; j < y + width; j++) {
-                    int idx = (i * imgWidth + j) * imgChannels;
-                    
-                    uint8_t r = currImgData[idx + 0];
-                    uint8_t g = currImgData[idx + 1];
-                    uint8_t b = currImgData[idx + 2];
-                    
-                    sumR += r;
-                    sumG += g;
-                    sumB += b;
-                }
+        double calculateError(const unsigned char* currImgData, int x, int y, int width, int height, double& avgR, double& avgG, double& avgB) const override {
+            long long n = (long long)width * height;
+            if (n == 0) {
+                return 0;
             }
-            
-            int n = width * height;
-            avgR = sumR / n;
-            avgG = sumG / n;
-            avgB = sumB / n;
-            
-            // Calculate absolute deviations for each channel
-            for (int i = x; i < x + height; i++) {
-                for (int j = y; j < y + width; j++) {
-                    int idx = (i * imgWidth + j) * imgChannels;
-                    
-                    uint8_t r = currImgData[idx + 0];
-                    uint8_t g = currImgData[idx + 1];
-                    uint8_t b = currImgData[idx + 2];
-                    
-                    sumAbsDevR += fabs(r - avgR);
-                    sumAbsDevG += fabs(g - avgG);
-                    sumAbsDevB += fabs(b - avgB);
+
+            // The deviations add up to about MAD * n^2, past long long for the large regions of a gigapixel image
+            long long sum[3] = {0, 0, 0};
+            unsigned __int128 absDev[3] = {0, 0, 0};
+            const unsigned int* hist = histograms.find(x, y, width, height);
+
+            if (hist != nullptr) {
+
+                // Large region, every deviation of a value is the same, so weigh them by the histogram
+                for (int c = 0; c < 3; c++) {
+                    const unsigned int* channel = hist + c * HistogramTree::BINS;
+                    for (int v = 0; v < HistogramTree::BINS; v++) sum[c] += (long long)channel[v] * v;
+                    for (int v = 0; v < HistogramTree::BINS; v++) {
+                        if (channel[v]) absDev[c] += (unsigned __int128)channel[v] * (unsigned long long)llabs(n * v - sum[c]);
+                    }
                 }
             }
+            else {
+
+                // Small region, one pass for the sums and one for the deviations
+                long long smallDev[3];
+                RegionKernels::sum(currImgData, imgWidth, imgChannels, x, y, width, height, sum);
+                RegionKernels::absDeviation(currImgData, imgWidth, imgChannels, x, y, width, height, sum, smallDev);
+                for (int c = 0; c < 3; c++) absDev[c] = smallDev[c];
+            }
+            
+            avgR = (double)sum[0] / n;
+            avgG = (double)sum[1] / n;
+            avgB = (double)sum[2] / n;
             
-            double madR = sumAbsDevR / n;
-            double madG = sumAbsDevG / n;
-            double madB = sumAbsDevB / n;
+            double madR = (double)absDev[0] / ((double)n * n);
+            double madG = (double)absDev[1] / ((double)n * n);
+            double madB = (double)absDev[2] / ((double)n * n);
             
             // Calculate the final error value as the average of MADs across all channels
             return (madR + madG + madB) / 3.0;
         }
+
+        /**
+         * @brief Get the number of pixels read one by one for a region, the pixels of a region without a table entry
+         * @param x Starting x-coordinate
+         * @param y Starting y-coordinate
+         * @param width Width of the region
+         * @param height Height of the region
+         * @return Area of the region if it is scanned, 0 if not
+         */
+        long long getScannedPixels(int x, int y, int width, int height) const override {
+            return histograms.find(x, y, width, height) == nullptr ? (long long)width * height : 0;
+        }
+
+        /**
+         * @brief Calculate mean absolute deviation from the histogram of a region, the same sums as a large region
+         * @param hist Histogram of 3 * BINS counts, red then green then blue
+         * @param n Number of pixels of the region
+         * @param avgR Output average red value of the region
+         * @param avgG Output average green value of the region
+         * @param avgB Output average blue value of the region
+         * @return Average MAD across RGB channels
+         */
+        static double measureHistogram(const unsigned long long* hist, long long n, double& avgR, double& avgG, double& avgB) {
+            if (n == 0) {
+                return 0;
+            }
+
+            // Summed in 128 bits like calculateError, the root of a tiled gigapixel image is always measured here
+            long long sum[3] = {0, 0, 0};
+            unsigned __int128 absDev[3] = {0, 0, 0};
+            for (int c = 0; c < 3; c++) {
+                const unsigned long long* channel = hist + c * HistogramTree::BINS;
+                for (int v = 0; v < HistogramTree::BINS; v++) sum[c] += (long long)channel[v] * v;
+                for (int v = 0; v < HistogramTree::BINS; v++) {
+                    if (channel[v]) absDev[c] += (unsigned __int128)channel[v] * (unsigned long long)llabs(n * v - sum[c]);
+                }
+            }
+
+            avgR = (double)sum[0] / n;
+            avgG = (double)sum[1] / n;
+            avgB = (double)sum[2] / n;
+
+            double madR = (double)absDev[0] / ((double)n * n);
+            double madG = (double)absDev[1] / ((double)n * n);
+            double madB = (double)absDev[2] / ((double)n * n);
+            return (madR + madG + madB) / 3.0;
+        }
+};
+
+/**
+ * @brief Per-channel minimum, maximum and sum of the regions the quadtree splits into, combined bottom-up from the children
+ *        Nodes follow the quadtree split geometry down to regions of MIN_NODE_AREA pixels, smaller regions are scanned directly
+ * @param MIN_NODE_AREA Smallest region in pixels that keeps its statistics
+ * @param nodes Regions with statistics, the root first
+ * @param imgWidth Width of the image in pixels
+ * @param imgChannels Number of color channels of the image
+ */
+class MinMaxTree {
+
+    public:
+        static constexpr long long MIN_NODE_AREA = 8 * 8;
+
+        struct Stats {
+            unsigned char min[3], max[3];
+            long long sum[3];
+        };
+
+    private:
+        struct Node {
+            int x, y, width, height;
+            int child[4];
+            Stats stats;
+        };
+
+        vector<Node> nodes;
+        int imgWidth, imgChannels;
+
+        /**
+         * @brief Build the node of a region and its subtree, combining the statistics of the children into it
+         * @param image Pointer to image data
+         * @param x Starting row
+         * @param y Starting column
+         * @param width Width of the region
+         * @param height Height of the region
+         * @return Index of the node
+         */
+        int build(const unsigned char* image, int x, int y, int width, int height) {
+            int index = nodes.size();
+            nodes.push_back({x, y, width, height, {-1, -1, -1, -1}, {}});
+            Stats stats = {{255, 255, 255}, {0, 0, 0}, {0, 0, 0}};
+
+            int children[4][4] = {
+                {x, y, width / 2, height / 2},
+                {x + height / 2, y, width / 2, height - height / 2},
+                {x, y + width / 2, width - width / 2, height / 2},
+                {x + height / 2, y + width / 2, width - width / 2, height - height / 2}
+            };
+
+            for (int k = 0; k < 4; k++) {
+                int* c = children[k];
+
+                if ((long long)c[2] * c[3] >= MIN_NODE_AREA) {
+                    int child = build(image, c[0], c[1], c[2], c[3]);
+                    nodes[index].child[k] = child;
+                    merge(stats, nodes[child].stats);
+                }
+                else {
+                    addPixels(stats, image, c[0], c[1], c[2], c[3]);
+                }
+            }
+
+            nodes[index].stats = stats;
+            return index;
+        }
+
+        /**
+         * @brief Combine the statistics of a region into another
+         * @param to Statistics combined into
+         * @param from Statistics of the region
+         */
+        static void merge(Stats& to, const Stats& from) {
+            for (int c = 0; c < 3; c++) {
+                to.min[c] = std::min(to.min[c], from.min[c]);
+                to.max[c] = std::max(to.max[c], from.max[c]);
+                to.sum[c] += from.sum[c];
+            }
+        }
+
+    public:
+        /**
+         * @brief Constructor that builds the whole tree
+         * @param image Pointer to image data
+         * @param imgWidth Width of the image in pixels
+         * @param imgHeight Height of the image in pixels
+         * @param imgChannels Number of color channels of the image
+         */
+        MinMaxTree(const unsigned char* image, int imgWidth, int imgHeight, int imgChannels) {
+            this -> imgWidth = imgWidth;
+            this -> imgChannels = imgChannels;
+            if ((long long)imgWidth * imgHeight >= MIN_NODE_AREA) build(image, 0, 0, imgWidth, imgHeight);
+        }
+
+        /**
+         * @brief Combine the pixels of a region into statistics
+         * @param stats Statistics combined into
+         * @param image Pointer to image data
+         * @param x Starting row
+         * @param y Starting column
+         * @param width Width of the region
+         * @param height Height of the region
+         */
+        void addPixels(Stats& stats, const unsigned char* image, int x, int y, int width, int height) const {
+            RegionKernels::minMax(image, imgWidth, imgChannels, x, y, width, height, stats.min, stats.max, stats.sum);
+        }
+
+        /**
+         * @brief Find the statistics of a region by descending from the root along the split geometry
+         * @param x Starting row
+         * @param y Starting column
+         * @param width Width of the region
+         * @param height Height of the region
+         * @return Statistics of the region, nullptr if the region has no node
+         */
+        const Stats* find(int x, int y, int width, int height) const {
+            if (nodes.empty() || (long long)width * height < MIN_NODE_AREA) return nullptr;
+
+            int index = 0;
+            while (index != -1) {
+                const Node& node = nodes[index];
+                if (node.x == x && node.y == y && node.width == width && node.height == height) {
+                    return &node.stats;
+                }
+
+                int next = -1;
+                for (int k = 0; k < 4 && next == -1; k++) {
+                    int child = node.child[k];
+                    if (child == -1) continue;
+
+                    const Node& c = nodes[child];
+                    if (x >= c.x && y >= c.y && x + height <= c.x + c.height && y + width <= c.y + c.width) next = child;
+                }
+                index = next;
+            }
+
+            return nullptr;
+        }
 };
 
 /**
  * @brief Implements error calculation using maximum pixel difference
+ * @param UPPER_THRESHOLD Maximum difference of an 8-bit channel
+ * @param ranges Minimum, maximum and sum of the regions down to 8x8 pixels
  */
 class MaxPixelDifference : public ErrorMethod {
 
+    private:
+        MinMaxTree ranges;
+
     public:
+        static constexpr double UPPER_THRESHOLD = 255.0;
+
         /**
-         * @brief Default Constructor that sets appropriate thresholds for max pixel difference
+         * @brief Constructor that sets appropriate thresholds for max pixel difference and builds the region statistics
+         * @param ctx Image context whose current image data is measured
          */
-        MaxPixelDifference() {
-            upperThreshold = 255.0;
+        MaxPixelDifference(const ImageContext& ctx) : ErrorMethod(ctx), ranges(ctx.currImgData, ctx.imgWidth, ctx.imgHeight, ctx.imgChannels) {
+            upperThreshold = UPPER_THRESHOLD;
             lowerThreshold = 0;
         }
         
@@ -369,66 +857,126 @@ class MaxPixelDifference : public ErrorMethod {
          * @param y Starting y-coordinate
          * @param width Width of the region
          * @param height Height of the region
+         * @param avgR Output average red value of the region
+         * @param avgG Output average green value of the region
+         * @param avgB Output average blue value of the region
          * @return Average MPD across RGB channels
          */
-        double calculateError(unsigned char* currImgData, int x, int y, int width, int height) override {
-            uint8_t minR = 255, minG = 255, minB = 255;
-            uint8_t maxR = 0, maxG = 0, maxB = 0;
-            double sumR = 0, sumG = 0, sumB = 0;
-            
-            // Calculate min and max values for each channel
-            for (int i = x; i < x + height; i++) {
-                for (int j = y; j < y + width; j++) {
-                    int idx = (i * imgWidth + j) * imgChannels;
-                    
-                    uint8_t r = currImgData[idx + 0];
-                    uint8_t g = currImgData[idx + 1];
-                    uint8_t b = currImgData[idx + 2];
-                    
-                    // Find min and max values for each channel
-                    minR = std::min(minR, r);
-                    minG = std::min(minG, g);
-                    minB = std::min(minB, b);
-                    maxR = std::max(maxR, r);
-                    maxG = std::max(maxG, g);
-                    maxB = std::max(maxB, b);
-
-                    sumR += r;
-                    sumG += g;
-                    sumB += b;
-                }
+        double calculateError(const unsigned char* currImgData, int x, int y, int width, int height, double& avgR, double& avgG, double& avgB) const override {
+            int n = width * height;
+            if (n == 0) {
+                return 0;
             }
-            
+
+            MinMaxTree::Stats region = {{255, 255, 255}, {0, 0, 0}, {0, 0, 0}};
+            const MinMaxTree::Stats* stats = ranges.find(x, y, width, height);
+
+            // Large regions were combined from their children, small ones are scanned
+            if (stats != nullptr) region = *stats;
+            else ranges.addPixels(region, currImgData, x, y, width, height);
+
             // Calculate the differences for each channel
-            double diffR = maxR - minR;
-            double diffG = maxG - minG;
-            double diffB = maxB - minB;
+            double diffR = region.max[0] - region.min[0];
+            double diffG = region.max[1] - region.min[1];
+            double diffB = region.max[2] - region.min[2];
 
             // Assign average values for each channel
-            int n = width * height;
-            avgR = sumR / n;
-            avgG = sumG / n;
-            avgB = sumB / n;
+            avgR = (double)region.sum[0] / n;
+            avgG = (double)region.sum[1] / n;
+            avgB = (double)region.sum[2] / n;
             
             // Calculate the final error value as the average of differences across all channels
             return (diffR + diffG + diffB) / 3.0;
         }
+
+        /**
+         * @brief Get the number of pixels read one by one for a region, the pixels of a region without a table entry
+         * @param x Starting x-coordinate
+         * @param y Starting y-coordinate
+         * @param width Width of the region
+         * @param height Height of the region
+         * @return Area of the region if it is scanned, 0 if not
+         */
+        long long getScannedPixels(int x, int y, int width, int height) const override {
+            return ranges.find(x, y, width, height) == nullptr ? (long long)width * height : 0;
+        }
+
+        /**
+         * @brief Calculate maximum pixel difference from the histogram of a region, between its first and last used bins
+         * @param hist Histogram of 3 * 256 counts, red then green then blue
+         * @param count Number of pixels of the region
+         * @param avgR Output average red value of the region
+         * @param avgG Output average green value of the region
+         * @param avgB Output average blue value of the region
+         * @return Average MPD across RGB channels
+         */
+        static double measureHistogram(const unsigned long long* hist, long long count, double& avgR, double& avgG, double& avgB) {
+            if (count == 0) {
+                return 0;
+            }
+
+            MinMaxTree::Stats region = {{255, 255, 255}, {0, 0, 0}, {0, 0, 0}};
+            for (int c = 0; c < 3; c++) {
+                for (int v = 0; v < 256; v++) {
+                    if (hist[c * 256 + v] == 0) continue;
+                    region.min[c] = std::min(region.min[c], (unsigned char)v);
+                    region.max[c] = (unsigned char)v;
+                    region.sum[c] += (long long)hist[c * 256 + v] * v;
+                }
+            }
+
+            double diffR = region.max[0] - region.min[0];
+            double diffG = region.max[1] - region.min[1];
+            double diffB = region.max[2] - region.min[2];
+
+            int n = count;
+            avgR = (double)region.sum[0] / n;
+            avgG = (double)region.sum[1] / n;
+            avgB = (double)region.sum[2] / n;
+            return (diffR + diffG + diffB) / 3.0;
+        }
 };
 
 /**
  * @brief Implements error calculation using entropy of pixel values
+ *        Shifting every value of a channel by the same average keeps its histogram counts, so the entropy comes from the value histogram,
+ *        log2(n) - sum c * log2(c) / n, taken from a region histogram or counted from the pixels
+ * @param UPPER_THRESHOLD Maximum entropy of an 8-bit channel, log2(256)
+ * @param histograms Histograms of the large regions
+ * @param countLog c * log2(c) of every count a scanned region can have
  */
 class Entropy : public ErrorMethod {
 
+    private:
+        HistogramTree histograms;
+        vector<double> countLog;
+
+        /**
+         * @brief Get c * log2(c) of a histogram count
+         * @param count Histogram count
+         * @return count * log2(count), 0 for an empty bin
+         */
+        double getCountLog(unsigned int count) const {
+            if (count < countLog.size()) return countLog[count];
+            return count * std::log2((double)count);
+        }
+
     public:
+        static constexpr double UPPER_THRESHOLD = 8.0;
+
         /**
-         * @brief Default Constructor that sets appropriate thresholds for entropy
+         * @brief Default Constructor that sets appropriate thresholds for entropy and builds the region histograms
          * @param upperThreshold 8.0 (maximum entropy for 8-bit channels, log2(256) = 8)
          * @param lowerThreshold 0 (minimum entropy, no variation in pixel values)
+         * @param ctx Image context whose current image data is measured
          */
-        Entropy() {
-            upperThreshold = 8.0;
+        Entropy(const ImageContext& ctx) : ErrorMethod(ctx), histograms(ctx.currImgData, ctx.imgWidth, ctx.imgHeight, ctx.imgChannels) {
+            upperThreshold = UPPER_THRESHOLD;
             lowerThreshold = 0;
+
+            // Scanned regions are smaller than a histogram node, so none of their counts reach it
+            countLog.resize(HistogramTree::MIN_NODE_AREA + 1, 0);
+            for (size_t c = 2; c < countLog.size(); c++) countLog[c] = c * std::log2((double)c);
         }
     
         /**
@@ -438,164 +986,140 @@ class Entropy : public ErrorMethod {
          * @param y Starting y-coordinate
          * @param width Width of the region
          * @param height Height of the region
+         * @param avgR Output average red value of the region
+         * @param avgG Output average green value of the region
+         * @param avgB Output average blue value of the region
          * @return Average entropy across RGB channels
          */
-        double calculateError(unsigned char* currImgData, int x, int y, int width, int height) override {
-            std::unordered_map<int, int> histR, histG, histB;
-            double sumR = 0, sumG = 0, sumB = 0;
-            int n = width * height;
-        
-            // Calculate average values for each channel
-            for (int i = x; i < x + height; i++) {
-                for (int j = y; j < y + width; j++) {
-                    int idx = (i * imgWidth + j) * imgChannels;
-        
-                    uint8_t r = currImgData[idx + 0];
-                    uint8_t g = currImgData[idx + 1];
-                    uint8_t b = currImgData[idx + 2];
-        
-                    sumR += r;
-                    sumG += g;
-                    sumB += b;
+        double calculateError(const unsigned char* currImgData, int x, int y, int width, int height, double& avgR, double& avgG, double& avgB) const override {
+            long long n = (long long)width * height;
+            if (n == 0) {
+                return 0;
+            }
+
+            long long sum[3] = {0, 0, 0};
+            double sumCountLog[3] = {0, 0, 0};
+            const unsigned int* hist = histograms.find(x, y, width, height);
+
+            if (hist != nullptr) {
+
+                // Large region, sweep the bins of its histogram
+                for (int c = 0; c < 3; c++) {
+                    const unsigned int* channel = hist + c * HistogramTree::BINS;
+                    for (int v = 0; v < HistogramTree::BINS; v++) {
+                        if (channel[v] == 0) continue;
+                        sum[c] += (long long)channel[v] * v;
+                        sumCountLog[c] += getCountLog(channel[v]);
+                    }
                 }
             }
-            
-            avgR = sumR / n;
-            avgG = sumG / n;
-            avgB = sumB / n;
-        
-            // Build histograms for each channel
-            for (int i = x; i < x + height; i++) {
-                for (int j = y; j < y + width; j++) {
-                    int idx = (i * imgWidth + j) * imgChannels;
-        
-                    int dr = static_cast<int>(currImgData[idx + 0]) - static_cast<int>(avgR);
-                    int dg = static_cast<int>(currImgData[idx + 1]) - static_cast<int>(avgG);
-                    int db = static_cast<int>(currImgData[idx + 2]) - static_cast<int>(avgB);
-        
-                    histR[dr]++;
-                    histG[dg]++;
-                    histB[db]++;
+            else {
+
+                // Small region, count its pixels, then visit the bins they hit, clearing each once it is taken
+                unsigned int counts[3 * HistogramTree::BINS] = {};
+                histograms.addPixels(counts, currImgData, x, y, width, height);
+
+                for (int i = x; i < x + height; i++) {
+                    const unsigned char* pixel = currImgData + ((size_t)i * imgWidth + y) * imgChannels;
+                    for (int j = 0; j < width; j++, pixel += imgChannels) {
+                        for (int c = 0; c < 3; c++) {
+                            unsigned int& count = counts[c * HistogramTree::BINS + pixel[c]];
+                            sum[c] += pixel[c];
+                            if (count == 0) continue;
+                            sumCountLog[c] += countLog[count];
+                            count = 0;
+                        }
+                    }
                 }
             }
-        
+
+            avgR = (double)sum[0] / n;
+            avgG = (double)sum[1] / n;
+            avgB = (double)sum[2] / n;
+
             // Calculate entropy for each channel
-            auto computeEntropy = [&](const std::unordered_map<int, int>& hist) -> double {
-                double entropy = 0;
-                for (const auto& x : hist) {
-                    int count = x.second;
-                    double p = static_cast<double>(count) / n;
-                    entropy -= p * std::log2(p);
-                }
-                return entropy;
-            };
-        
-            double entropyR = computeEntropy(histR);
-            double entropyG = computeEntropy(histG);
-            double entropyB = computeEntropy(histB);
+            double logN = std::log2((double)n);
+            double entropyR = logN - sumCountLog[0] / n;
+            double entropyG = logN - sumCountLog[1] / n;
+            double entropyB = logN - sumCountLog[2] / n;
         
             // Calculate the final error value as the average of entropies across all channels
             return (entropyR + entropyG + entropyB) / 3.0;
         }
+
+        /**
+         * @brief Get the number of pixels read one by one for a region, the pixels of a region without a table entry
+         * @param x Starting x-coordinate
+         * @param y Starting y-coordinate
+         * @param width Width of the region
+         * @param height Height of the region
+         * @return Area of the region if it is scanned, 0 if not
+         */
+        long long getScannedPixels(int x, int y, int width, int height) const override {
+            return histograms.find(x, y, width, height) == nullptr ? (long long)width * height : 0;
+        }
+
+        /**
+         * @brief Calculate entropy from the histogram of a region, sweeping its bins like a large region
+         * @param hist Histogram of 3 * BINS counts, red then green then blue
+         * @param n Number of pixels of the region
+         * @param avgR Output average red value of the region
+         * @param avgG Output average green value of the region
+         * @param avgB Output average blue value of the region
+         * @return Average entropy across RGB channels
+         */
+        static double measureHistogram(const unsigned long long* hist, long long n, double& avgR, double& avgG, double& avgB) {
+            if (n == 0) {
+                return 0;
+            }
+
+            long long sum[3] = {0, 0, 0};
+            double sumCountLog[3] = {0, 0, 0};
+            for (int c = 0; c < 3; c++) {
+                const unsigned long long* channel = hist + c * HistogramTree::BINS;
+                for (int v = 0; v < HistogramTree::BINS; v++) {
+                    if (channel[v] == 0) continue;
+                    sum[c] += (long long)channel[v] * v;
+                    sumCountLog[c] += channel[v] * std::log2((double)channel[v]);
+                }
+            }
+
+            avgR = (double)sum[0] / n;
+            avgG = (double)sum[1] / n;
+            avgB = (double)sum[2] / n;
+
+            double logN = std::log2((double)n);
+            double entropyR = logN - sumCountLog[0] / n;
+            double entropyG = logN - sumCountLog[1] / n;
+            double entropyB = logN - sumCountLog[2] / n;
+            return (entropyR + entropyG + entropyB) / 3.0;
+        }
 };
 
 /**
  * @brief Implements error calculation using Structural Similarity Index
+ * @param UPPER_THRESHOLD Maximum SSIM-based error
  * @param C2 Constant for stability in SSIM calculation, (0.03 * 225)^2 = 58.5225
- * @param sumR 2D array for red channel sum
- * @param sumG 2D array for green channel sum
- * @param sumB 2D array for blue channel sum
- * @param sumR2 2D array for squared red channel sum
- * @param sumG2 2D array for squared green channel sum
- * @param sumB2 2D array for squared blue channel sum
+ * @param integral Integral image of the channels and their squares
  */
 class SSIM : public ErrorMethod {
 
     private:
-        const double C2 = 58.5225;
-        double** sumR;
-        double** sumG;
-        double** sumB;
-        double** sumR2;
-        double** sumG2;
-        double** sumB2;
+        static constexpr double C2 = 58.5225;
+        IntegralImage integral;
         
     public:
+        static constexpr double UPPER_THRESHOLD = 1.0;
+
         /**
-         * @brief Constructor that initializes integral image arrays
+         * @brief Constructor that builds the integral image
+         * @param ctx Image context whose current image data is measured
          */
-        SSIM() {
+        SSIM(const ImageContext& ctx) : ErrorMethod(ctx), integral(ctx.currImgData, ctx.imgWidth, ctx.imgHeight, ctx.imgChannels, ctx.lowMemory) {
+
             // Default values for upper and lower thresholds in SSIM method
-            upperThreshold = 1.0;
+            upperThreshold = UPPER_THRESHOLD;
             lowerThreshold = 0;
-
-            // Initialize integral image arrays
-            sumR = new double*[imgHeight];
-            sumG = new double*[imgHeight];
-            sumB = new double*[imgHeight];
-            sumR2 = new double*[imgHeight];
-            sumG2 = new double*[imgHeight];
-            sumB2 = new double*[imgHeight];
-
-            // Allocate memory for each row of the integral image arrays
-            for (int i = 0; i < imgHeight; ++i) {
-                sumR[i] = new double[imgWidth];
-                sumG[i] = new double[imgWidth];
-                sumB[i] = new double[imgWidth];
-                sumR2[i] = new double[imgWidth];
-                sumG2[i] = new double[imgWidth];
-                sumB2[i] = new double[imgWidth];
-            }
-
-            // Calculate integral images for the current image data
-            for (int i = 0; i < imgHeight; i++) {
-                for (int j = 0; j < imgWidth; j++) {
-                    int idx = (i * imgWidth + j) * imgChannels;
-
-                    // Initialize integral image arrays with pixel values
-                    sumR[i][j] = currImgData[idx + 0];
-                    sumG[i][j] = currImgData[idx + 1];
-                    sumB[i][j] = currImgData[idx + 2];
-                    sumR2[i][j] = currImgData[idx + 0] * currImgData[idx + 0];
-                    sumG2[i][j] = currImgData[idx + 1] * currImgData[idx + 1];
-                    sumB2[i][j] = currImgData[idx + 2] * currImgData[idx + 2];
-
-                    // For the top-left pixel, no need to add anything
-                    if (i == 0 && j == 0) {
-                        continue;
-                    }
-
-                    // For the first row, only add the previous column pixel value
-                    else if (i == 0) {
-                        sumR[i][j] += sumR[i][j - 1];
-                        sumG[i][j] += sumG[i][j - 1];
-                        sumB[i][j] += sumB[i][j - 1];
-                        sumR2[i][j] += sumR2[i][j - 1];
-                        sumG2[i][j] += sumG2[i][j - 1];
-                        sumB2[i][j] += sumB2[i][j - 1];
-                    }
-
-                    // For the first column, add the previous row pixel value
-                    else if (j == 0) {
-                        sumR[i][j] += sumR[i - 1][j];
-                        sumG[i][j] += sumG[i - 1][j];
-                        sumB[i][j] += sumB[i - 1][j];
-                        sumR2[i][j] += sumR2[i - 1][j];
-                        sumG2[i][j] += sumG2[i - 1][j];
-                        sumB2[i][j] += sumB2[i - 1][j];
-                    }
-                    
-                    // For all other pixels, add the values from the left and top pixels
-                    else {
-                        sumR[i][j] += sumR[i - 1][j] + sumR[i][j - 1] - sumR[i - 1][j - 1];
-                        sumG[i][j] += sumG[i - 1][j] + sumG[i][j - 1] - sumG[i - 1][j - 1];
-                        sumB[i][j] += sumB[i - 1][j] + sumB[i][j - 1] - sumB[i - 1][j - 1];
-                        sumR2[i][j] += sumR2[i - 1][j] + sumR2[i][j - 1] - sumR2[i - 1][j - 1];
-                        sumG2[i][j] += sumG2[i - 1][j] + sumG2[i][j - 1] - sumG2[i - 1][j - 1];
-                        sumB2[i][j] += sumB2[i - 1][j] + sumB2[i][j - 1] - sumB2[i - 1][j - 1];
-                    }
-                }
-            }
         }
         
         /**
@@ -605,9 +1129,12 @@ class SSIM : public ErrorMethod {
          * @param y Starting y-coordinate
          * @param width Width of the region
          * @param height Height of the region
+         * @param avgR Output average red value of the region
+         * @param avgG Output average green value of the region
+         * @param avgB Output average blue value of the region
          * @return Inverse of average SSIM across RGB channels
          */
-        double calculateError(unsigned char* currImgData, int x, int y, int width, int height) override {
+        double calculateError([[maybe_unused]] const unsigned char* currImgData, int x, int y, int width, int height, double& avgR, double& avgG, double& avgB) const override {
             int x1 = x;
             int y1 = y;
             int x2 = x + height - 1;
@@ -625,32 +1152,19 @@ class SSIM : public ErrorMethod {
                 return 0;
             }
 
-            // Helper lambda to extract sum from integral image
-            auto getSum = [&](double** integral) -> double {
-                double total = integral[x2][y2];
-                if (x1 > 0) total -= integral[x1 - 1][y2];
-                if (y1 > 0) total -= integral[x2][y1 - 1];
-                if (x1 > 0 && y1 > 0) total += integral[x1 - 1][y1 - 1];
-                return total;
-            };
-            
-            // Calculate sums for each channel using the integral images
-            double sumRVal = getSum(sumR);
-            double sumGVal = getSum(sumG);
-            double sumBVal = getSum(sumB);
-            double sumR2Val = getSum(sumR2);
-            double sumG2Val = getSum(sumG2);
-            double sumB2Val = getSum(sumB2);
+            // Integer sums are exact, the same values the double integral images used to give
+            long long sum[3], sq[3];
+            integral.query(x, y, width, height, sum, sq);
 
             // Calculate mean values for each channel
-            avgR = sumRVal / n;
-            avgG = sumGVal / n;
-            avgB = sumBVal / n;
+            avgR = (double)sum[0] / n;
+            avgG = (double)sum[1] / n;
+            avgB = (double)sum[2] / n;
 
             // Calculate variance for each channel
-            double varR = (sumR2Val / n) - (avgR * avgR);
-            double varG = (sumG2Val / n) - (avgG * avgG);
-            double varB = (sumB2Val / n) - (avgB * avgB);
+            double varR = ((double)sq[0] / n) - (avgR * avgR);
+            double varG = ((double)sq[1] / n) - (avgG * avgG);
+            double varB = ((double)sq[2] / n) - (avgB * avgB);
 
             // Calculate the SSIM value across all channels
             double ssimR = C2 / (varR + C2);
@@ -660,6 +1174,75 @@ class SSIM : public ErrorMethod {
             // Calculate the final error value as the inverse of average SSIM across all channels
             return (1.0 - ssimR + 1.0 - ssimG + 1.0 - ssimB) / 3.0;
         }
+
+        /**
+         * @brief Calculate SSIM-based error from the histogram of a region, the sums are the exact ones of the integral image
+         * @param hist Histogram of 3 * 256 counts, red then green then blue
+         * @param count Number of pixels of the region
+         * @param avgR Output average red value of the region
+         * @param avgG Output average green value of the region
+         * @param avgB Output average blue value of the region
+         * @return Inverse of average SSIM across RGB channels
+         */
+        static double measureHistogram(const unsigned long long* hist, long long count, double& avgR, double& avgG, double& avgB) {
+            int n = count;
+            if (n == 0) {
+                return 0;
+            }
+
+            long long sum[3] = {0, 0, 0}, sq[3] = {0, 0, 0};
+            for (int c = 0; c < 3; c++) {
+                for (int v = 0; v < 256; v++) {
+                    sum[c] += (long long)hist[c * 256 + v] * v;
+                    sq[c] += (long long)hist[c * 256 + v] * v * v;
+                }
+            }
+
+            avgR = (double)sum[0] / n;
+            avgG = (double)sum[1] / n;
+            avgB = (double)sum[2] / n;
+
+            double varR = ((double)sq[0] / n) - (avgR * avgR);
+            double varG = ((double)sq[1] / n) - (avgG * avgG);
+            double varB = ((double)sq[2] / n) - (avgB * avgB);
+
+            double ssimR = C2 / (varR + C2);
+            double ssimG = C2 / (varG + C2);
+            double ssimB = C2 / (varB + C2);
+            return (1.0 - ssimR + 1.0 - ssimG + 1.0 - ssimB) / 3.0;
+        }
 };
 
+inline void ErrorMethod::getThresholdRange(int mode, double& lower, double& upper) {
+    lower = 0;
+    switch(mode) {
+        case 1: upper = Variance::UPPER_THRESHOLD; break;
+        case 2: upper = MeanAbsoluteDeviation::UPPER_THRESHOLD; break;
+        case 3: upper = MaxPixelDifference::UPPER_THRESHOLD; break;
+        case 4: upper = Entropy::UPPER_THRESHOLD; break;
+        case 5: upper = SSIM::UPPER_THRESHOLD; break;
+        default: upper = Variance::UPPER_THRESHOLD; break;
+    }
+}
+
+inline ErrorMethod* ErrorMethod::create(int mode, const ImageContext& ctx) {
+    switch(mode) {
+        case 2: return new MeanAbsoluteDeviation(ctx);
+        case 3: return new MaxPixelDifference(ctx);
+        case 4: return new Entropy(ctx);
+        case 5: return new SSIM(ctx);
+        default: return new Variance(ctx);
+    }
+}
+
+inline double ErrorMethod::histogramError(int mode, const unsigned long long* hist, long long n, double& avgR, double& avgG, double& avgB) {
+    switch(mode) {
+        case 2: return MeanAbsoluteDeviation::measureHistogram(hist, n, avgR, avgG, avgB);
+        case 3: return MaxPixelDifference::measureHistogram(hist, n, avgR, avgG, avgB);
+        case 4: return Entropy::measureHistogram(hist, n, avgR, avgG, avgB);
+        case 5: return SSIM::measureHistogram(hist, n, avgR, avgG, avgB);
+        default: return Variance::measureHistogram(hist, n, avgR, avgG, avgB);
+    }
+}
+
 #endif
\ No newline at end of file
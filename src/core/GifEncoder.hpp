@@ -0,0 +1,376 @@
+#ifndef GIFENCODER_HPP
+#define GIFENCODER_HPP
+
+// Libraries
+#include <condition_variable>
+#include "ThreadPool.hpp"
+#include "Stats.hpp"
+#include "RegionKernels.hpp"
+#include "../libs/gif.h"
+
+/**
+ * @brief GIF writer that encodes frames on a background thread, so the quadtree keeps building while earlier levels are encoded
+ *        A frame covers only the rectangle that changed, and its palette is median-cut from the colors the caller knows it painted,
+ *        or from the changed pixels when it gives none, the pixels equal to the previous frame stay transparent
+ *        The top levels of the palette split and the nearest-color mapping of row bands are spread over a thread pool,
+ *        the LZW stream stays on the background thread
+ * @param MAX_PENDING Frames queued before write waits for the encoder
+ * @param PALETTE_TASK_LEVELS Levels of the palette split tree whose halves are split as separate tasks
+ * @param BAND_ROWS Rows of a band mapped to palette colors as one task
+ * @param g GIF writer of gif.h, its image holds the palette indices of the whole canvas
+ * @param lastFrame Pixels of the whole canvas as they were last written, RGBA
+ * @param width Width of the frames in pixels
+ * @param height Height of the frames in pixels
+ * @param threads Number of threads encoding a frame
+ * @param frames Frames waiting for the encoder, RGBA
+ * @param closing Whether the encoder stops once the queue is empty
+ * @param written Whether a frame has been queued, the first one covering the whole canvas
+ * @param worker Background encoding thread
+ * @param pool Thread pool shared by every frame, created with the first frame when more than one thread encodes
+ * @param stats Stats the encoding time of every frame is added to, nullptr for none
+ */
+class GifEncoder {
+
+    public:
+        static constexpr size_t MAX_PENDING = 4;
+        static constexpr int PALETTE_TASK_LEVELS = 4;
+        static constexpr int BAND_ROWS = 32;
+
+    private:
+        struct Frame {
+            vector<uint8_t> pixels;
+            vector<uint32_t> colors;
+            uint32_t delay;
+            int left, top, width, height;
+        };
+
+        GifWriter g;
+        vector<uint8_t> lastFrame;
+        int width, height, threads;
+
+        mutex lock;
+        condition_variable changed;
+        deque<Frame> frames;
+        bool closing, written;
+        thread worker;
+        unique_ptr<ThreadPool> pool;
+        CompressionStats* stats;
+
+        /**
+         * @brief Encode queued frames in order until the encoder is closed, then stop the pool
+         */
+        void run() {
+            while (true) {
+                Frame frame;
+                {
+                    unique_lock<mutex> guard(lock);
+                    changed.wait(guard, [this]() { return closing || !frames.empty(); });
+                    if (frames.empty()) break;
+                    frame = move(frames.front());
+                    frames.pop_front();
+                    if (!pool && threads > 1) pool.reset(new ThreadPool(threads));
+                }
+                changed.notify_all();
+
+                CompressionStats::Timer timer(stats, CompressionStats::GIF_ENCODE);
+                encode(frame);
+            }
+            pool.reset();
+        }
+
+        /**
+         * @brief Split a node of the palette tree like GifSplitPalette, handing both halves of the top levels to the pool
+         *        The halves sort disjoint parts of the image and fill disjoint palette entries, so the palette is the same
+         * @param pool Thread pool, nullptr to split on the calling thread
+         * @param image Pixels of the node, reordered in place
+         * @param numPixels Number of pixels of the node
+         * @param treeNode Index of the node in the palette tree
+         * @param treeLevel Depth of the node in the palette tree
+         * @param pal Palette being built
+         */
+        static void splitPalette(ThreadPool* pool, uint8_t* image, int numPixels, int treeNode, int treeLevel, GifPalette* pal) {
+            int numColors = 1 << pal -> bitDepth;
+            if (pool == nullptr || numPixels == 0 || treeNode >= numColors || treeLevel >= PALETTE_TASK_LEVELS) {
+                GifSplitPalette(image, numPixels, treeNode, treeLevel, false, pal);
+                return;
+            }
+
+            // Find the axis with the largest range
+            int minC[3] = {255, 255, 255}, maxC[3] = {0, 0, 0};
+            for (int i = 0; i < numPixels; i++) {
+                for (int c = 0; c < 3; c++) {
+                    minC[c] = min(minC[c], (int)image[i * 4 + c]);
+                    maxC[c] = max(maxC[c], (int)image[i * 4 + c]);
+                }
+            }
+
+            int rRange = maxC[0] - minC[0], gRange = maxC[1] - minC[1], bRange = maxC[2] - minC[2];
+            int splitCom = 1;
+            if (bRange > gRange) splitCom = 2;
+            if (rRange > bRange && rRange > gRange) splitCom = 0;
+            int rangeMin = minC[splitCom], rangeMax = maxC[splitCom];
+
+            int subPixelsA = numPixels / 2;
+            GifPartitionByMedian(image, 0, numPixels, splitCom, subPixelsA);
+            int splitValue = image[subPixelsA * 4 + splitCom];
+
+            // If the split is very unbalanced, split at the mean instead of the median to preserve rare colors
+            int splitUnbalance = GifIAbs((splitValue - rangeMin) - (rangeMax - splitValue));
+            if (splitUnbalance > (1536 >> treeLevel)) {
+                splitValue = rangeMin + (rangeMax - rangeMin) / 2;
+                subPixelsA = GifPartitionByMean(image, 0, numPixels, splitCom, splitValue);
+            }
+
+            // The bottom node keeps the transparency index
+            if (treeNode == numColors / 2) {
+                subPixelsA = 0;
+                splitValue = 0;
+            }
+
+            int subPixelsB = numPixels - subPixelsA;
+            pal -> treeSplitElt[treeNode] = (uint8_t)splitCom;
+            pal -> treeSplit[treeNode] = (uint8_t)splitValue;
+
+            pool -> submit([pool, image, subPixelsA, treeNode, treeLevel, pal]() {
+                splitPalette(pool, image, subPixelsA, treeNode * 2, treeLevel + 1, pal);
+            });
+            splitPalette(pool, image + subPixelsA * 4, subPixelsB, treeNode * 2 + 1, treeLevel + 1, pal);
+        }
+
+        /**
+         * @brief Encode one frame: build its palette, map its changed pixels to palette indices, then write its rectangle
+         * @param frame Frame to encode
+         */
+        void encode(Frame& frame) {
+            bool first = g.firstFrame;
+            g.firstFrame = false;
+
+            // Median-cut the palette from the known colors, or from the changed pixels, split destroys its input
+            vector<uint8_t> source;
+            if (!frame.colors.empty()) {
+                sort(frame.colors.begin(), frame.colors.end());
+                frame.colors.erase(unique(frame.colors.begin(), frame.colors.end()), frame.colors.end());
+                for (uint32_t color : frame.colors) {
+                    source.insert(source.end(), {(uint8_t)(color >> 16), (uint8_t)(color >> 8), (uint8_t)color, 0});
+                }
+            }
+            else {
+                for (int i = 0; i < frame.height; i++) {
+                    const uint8_t* next = frame.pixels.data() + (size_t)i * frame.width * 4;
+                    const uint8_t* last = lastFrame.data() + ((size_t)(frame.top + i) * width + frame.left) * 4;
+                    for (int j = 0; j < frame.width; j++, next += 4, last += 4) {
+                        if (first || next[0] != last[0] || next[1] != last[1] || next[2] != last[2]) source.insert(source.end(), next, next + 4);
+                    }
+                }
+            }
+
+            // Entries of empty subtrees are never set by the split but still written and searched, so they start black
+            GifPalette pal = {};
+            pal.bitDepth = 8;
+            int numPixels = source.size() / 4;
+            if (pool) {
+                pool -> run([this, &source, numPixels, &pal]() {
+                    splitPalette(pool.get(), source.data(), numPixels, 1, 0, &pal);
+                });
+            }
+            else splitPalette(nullptr, source.data(), numPixels, 1, 0, &pal);
+
+            pal.treeSplit[1 << (pal.bitDepth - 1)] = 0;
+            pal.treeSplitElt[1 << (pal.bitDepth - 1)] = 0;
+            pal.r[0] = pal.g[0] = pal.b[0] = 0;
+
+            // Map the changed pixels to their palette colors, each pixel only reads and writes its own place
+            auto mapBand = [this, &frame, first, &pal](int top) {
+                for (int i = top; i < min(top + BAND_ROWS, frame.height); i++) {
+                    size_t offset = ((size_t)(frame.top + i) * width + frame.left) * 4;
+                    const uint8_t* next = frame.pixels.data() + (size_t)i * frame.width * 4;
+                    uint8_t* last = lastFrame.data() + offset;
+                    uint8_t* out = g.oldImage + offset;
+
+                    for (int j = 0; j < frame.width; j++, next += 4, last += 4, out += 4) {
+                        if (!first && next[0] == last[0] && next[1] == last[1] && next[2] == last[2]) {
+                            out[3] = kGifTransIndex;
+                            continue;
+                        }
+
+                        int32_t bestDiff = 1000000, bestInd = 1;
+                        GifGetClosestPaletteColor(&pal, next[0], next[1], next[2], &bestInd, &bestDiff, 1);
+                        out[0] = pal.r[bestInd];
+                        out[1] = pal.g[bestInd];
+                        out[2] = pal.b[bestInd];
+                        out[3] = (uint8_t)bestInd;
+                        memcpy(last, next, 3);
+                    }
+                }
+            };
+
+            if (pool) {
+                pool -> run([this, &frame, &mapBand]() {
+                    for (int top = 0; top < frame.height; top += BAND_ROWS) pool -> submit([&mapBand, top]() { mapBand(top); });
+                });
+            }
+            else {
+                for (int top = 0; top < frame.height; top += BAND_ROWS) mapBand(top);
+            }
+
+            // The LZW writer reads the rectangle as one contiguous image
+            vector<uint8_t> indices((size_t)frame.width * frame.height * 4);
+            for (int i = 0; i < frame.height; i++) {
+                memcpy(indices.data() + (size_t)i * frame.width * 4, g.oldImage + ((size_t)(frame.top + i) * width + frame.left) * 4, (size_t)frame.width * 4);
+            }
+            GifWriteLzwImage(g.f, indices.data(), frame.left, frame.top, frame.width, frame.height, frame.delay, &pal);
+        }
+
+    public:
+        /**
+         * @brief Default constructor for a closed encoder
+         */
+        GifEncoder() {
+            g.f = nullptr;
+            g.oldImage = nullptr;
+            width = 0;
+            height = 0;
+            threads = 1;
+            closing = false;
+            stats = nullptr;
+        }
+
+        GifEncoder(const GifEncoder&) = delete;
+        GifEncoder& operator=(const GifEncoder&) = delete;
+
+        /**
+         * @brief Destructor that finishes the file
+         */
+        ~GifEncoder() {
+            end();
+        }
+
+        /**
+         * @brief Create the GIF file and start the background encoder
+         * @param path Output GIF path
+         * @param width Width of the frames in pixels
+         * @param height Height of the frames in pixels
+         * @param delay Delay written in the file header
+         * @return True if the file was created
+         */
+        bool begin(const string& path, int width, int height, uint32_t delay) {
+            if (!GifBegin(&g, path.c_str(), width, height, delay)) {
+                g.f = nullptr;
+                return false;
+            }
+
+            this -> width = width;
+            this -> height = height;
+            lastFrame.assign((size_t)width * height * 4, 0);
+            closing = false;
+            written = false;
+            worker = thread([this]() { run(); });
+            return true;
+        }
+
+        /**
+         * @brief Check whether the file is being written
+         * @return True between a successful begin and end
+         */
+        bool isOpen() const {
+            return g.f != nullptr;
+        }
+
+        /**
+         * @brief Set the number of threads encoding a frame, before the first frame is written
+         * @param threads Thread count, 1 to encode on the background thread alone
+         */
+        void setThreads(int threads) {
+            lock_guard<mutex> guard(lock);
+            this -> threads = max(1, threads);
+        }
+
+        /**
+         * @brief Set the stats the encoding time of every frame is added to, before the first frame is written
+         * @param stats Stats of the compression, nullptr for none
+         */
+        void setStats(CompressionStats* stats) {
+            lock_guard<mutex> guard(lock);
+            this -> stats = stats;
+        }
+
+        /**
+         * @brief Queue a copy of a rectangle of an image as the next frame, waiting while MAX_PENDING frames are queued
+         *        The first frame always covers the whole canvas, an empty rectangle becomes one transparent pixel
+         * @param image Image data of the whole canvas
+         * @param channels Number of color channels of the image, 3 or 4
+         * @param delay Frame delay in hundredths of a second
+         * @param left Starting column of the changed rectangle
+         * @param top Starting row of the changed rectangle
+         * @param rectWidth Width of the changed rectangle
+         * @param rectHeight Height of the changed rectangle
+         * @param colors Colors painted in the rectangle as 0xRRGGBB, empty to build the palette from its pixels
+         */
+        void write(const unsigned char* image, int channels, uint32_t delay, int left, int top, int rectWidth, int rectHeight, vector<uint32_t> colors = {}) {
+            if (!isOpen()) return;
+
+            Frame frame;
+            frame.delay = delay;
+            frame.colors = move(colors);
+            frame.left = left;
+            frame.top = top;
+            frame.width = rectWidth;
+            frame.height = rectHeight;
+
+            if (!written) {
+                frame.left = frame.top = 0;
+                frame.width = width;
+                frame.height = height;
+                written = true;
+            }
+            else if (frame.width <= 0 || frame.height <= 0) {
+                frame.left = frame.top = 0;
+                frame.width = frame.height = 1;
+            }
+
+            // The encoder ignores the alpha byte, so RGBA rows are copied as they are
+            frame.pixels.resize((size_t)frame.width * frame.height * 4);
+            for (int i = 0; i < frame.height; i++) {
+                const unsigned char* row = image + ((size_t)(frame.top + i) * width + frame.left) * channels;
+                uint8_t* to = frame.pixels.data() + (size_t)i * frame.width * 4;
+                if (channels == 4) memcpy(to, row, (size_t)frame.width * 4);
+                else RegionKernels::expandRgba(row, to, frame.width);
+            }
+
+            {
+                unique_lock<mutex> guard(lock);
+                changed.wait(guard, [this]() { return frames.size() < MAX_PENDING; });
+                frames.push_back(move(frame));
+            }
+            changed.notify_all();
+        }
+
+        /**
+         * @brief Queue a copy of a whole image as the next frame
+         * @param image Image data
+         * @param channels Number of color channels of the image, 3 or 4
+         * @param delay Frame delay in hundredths of a second
+         */
+        void write(const unsigned char* image, int channels, uint32_t delay) {
+            write(image, channels, delay, 0, 0, width, height);
+        }
+
+        /**
+         * @brief Encode the queued frames, then finish and close the file
+         */
+        void end() {
+            if (!isOpen()) return;
+
+            {
+                lock_guard<mutex> guard(lock);
+                closing = true;
+            }
+            changed.notify_all();
+            worker.join();
+
+            GifEnd(&g);
+            g.f = nullptr;
+        }
+};
+
+#endif
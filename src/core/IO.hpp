@@ -10,28 +10,22 @@
 #include <thread>
 #include "QuadTree.hpp"
 
-extern atomic<bool> done;
-
-/**
- * @brief Image data buffers used throughout the compression process
- * @param currImgData Current image data buffer used for processing
- * @param initImgData Initial image data buffer kept as reference
- * @param tempImgData Temporary image data buffer for intermediate processing
- */
-extern unsigned char* currImgData, *initImgData, *tempImgData;
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
 
-/**
- * @brief Global image dimensions and format information
- * @param imgWidth Width of the image in pixels
- * @param imgHeight Height of the image in pixels
- * @param imgChannels Number of color channels (typically 3 for RGB, 4 for RGBA)
- */
-extern int imgWidth, imgHeight, imgChannels;
+extern atomic<bool> done;
 
 using namespace std;
 
 /**
  * @brief Handles user input validation and processing
+ * @param MAX_JOBS Most worker threads the --jobs flag accepts
+ * @param ctx Image context that receives the loaded input image
  * @param mode Selected error calculation mode (1-5)
  * @param minBlock Minimum block size in pixels
  * @param threshold Error threshold value
@@ -46,16 +40,52 @@ using namespace std;
  * @param gifPathDisplay Display version of GIF path
  * @param inputExtension Input image file extension
  * @param errorMethod Name of selected error method
+ * @param errorMessage Validation error of the command-line flags, empty if valid
+ * @param helpRequested Flag for printing the command-line usage only
+ * @param batchPath Directory or manifest of images for batch mode, empty for a single image
+ * @param decodePath Input .qtz file to decode into the output image, empty to compress
+ * @param benchPath Directory or manifest of images to benchmark, empty to compress
+ * @param benchFormat Format of the benchmark report, csv or json
+ * @param benchRepeat Runs of every benchmark case, the fastest is reported
+ * @param levelLayout Flag for laying a .qtz output out level by level
+ * @param maxDepth Deepest level decoded from a level-by-level .qtz file
+ * @param maxBytes Bytes decoded at most from a level-by-level .qtz file
+ * @param lowMemory Flag for keeping only the decoded image buffer and the smallest error tables
+ * @param tileSize Side of a tile of a tiled compression in pixels, 0 to compress the whole image at once
+ * @param outputDir Output directory for batch mode
+ * @param jobs Number of worker threads, batch workers or quadtree build threads for a single image, 0 for every hardware thread
+ * @param statsPath Output JSON path of the phase times and counters of the compression, empty to collect none
+ * @param stats Phase times and counters of the compression, collected through the image context when statsPath is set
+ * @param estimateSize Flag for predicting encoded sizes in the target search
+ * @param confirmSize Flag for confirming the predicted threshold with real encodes
  */
 class IOHandler {
 
+    public:
+        static constexpr int MAX_JOBS = 1024;
+
     private:
+        ImageContext& ctx;
         int mode, minBlock;
         double threshold, upperThreshold, lowerThreshold, targetPercentage;
         string inputPath, inputPathDisplay;
         string outputPath, outputPathDisplay;
         string gifPath, gifPathDisplay;
         string inputExtension, errorMethod;
+        string errorMessage;
+        bool helpRequested;
+        string batchPath, outputDir, decodePath;
+        string benchPath, benchFormat;
+        int benchRepeat;
+        bool levelLayout;
+        int maxDepth;
+        size_t maxBytes;
+        bool lowMemory;
+        int tileSize;
+        int jobs;
+        string statsPath;
+        CompressionStats stats;
+        bool estimateSize, confirmSize;
 
         /**
          * @brief Extract filename with extension from a path
@@ -274,7 +304,7 @@ class IOHandler {
                 }
                 
                 // Load image
-                string errorMsg = Image::loadImage(convertedPath, extension);
+                string errorMsg = Image::loadImage(ctx, convertedPath, extension);
                 if (!errorMsg.empty()) {
                     showLog(1);
                     cout << RESET RED BOLD << "[!]" << RESET BRIGHT_WHITE ITALIC << " Error: " << errorMsg << endl << endl;
@@ -356,38 +386,7 @@ class IOHandler {
             else if (mode == 4) errorMethod = "Entropy";
             else if (mode == 5) errorMethod = "Structural Similarity Index (SSIM)";
 
-            switch(mode) {
-                case 1: {
-                    Variance variance;
-                    upperThreshold = variance.getUpperThreshold();
-                    lowerThreshold = variance.getLowerThreshold();
-                    break;
-                }
-                case 2: {
-                    MeanAbsoluteDeviation mad;
-                    upperThreshold = mad.getUpperThreshold();
-                    lowerThreshold = mad.getLowerThreshold();
-                    break;
-                }
-                case 3: {
-                    MaxPixelDifference mpd;
-                    upperThreshold = mpd.getUpperThreshold();
-                    lowerThreshold = mpd.getLowerThreshold();
-                    break;
-                }
-                case 4: {
-                    Entropy entropy;
-                    upperThreshold = entropy.getUpperThreshold();
-                    lowerThreshold = entropy.getLowerThreshold();
-                    break;
-                }
-                case 5: {
-                    SSIM ssim;
-                    upperThreshold = ssim.getUpperThreshold();
-                    lowerThreshold = ssim.getLowerThreshold();
-                    break;
-                }
-            }
+            ErrorMethod::getThresholdRange(mode, lowerThreshold, upperThreshold);
         }
 
         /**
@@ -469,7 +468,7 @@ class IOHandler {
             bool isValid = false;
             showLog(4);
             
-            int maxBlockSize = imgWidth * imgHeight;
+            int maxBlockSize = ctx.imgWidth * ctx.imgHeight;
             
             while (!isValid) {
                 cout << RESET GREEN BOLD << ">>  " << BRIGHT_WHITE BAR_CURSOR;
@@ -638,7 +637,7 @@ class IOHandler {
                     continue;
                 }
 
-                if (extension != inputExtension) {
+                if (extension != inputExtension && extension != "qtz") {
                     showLog(6);
                     cout << RESET RED BOLD << "[!]" << RESET BRIGHT_WHITE ITALIC << " Error: Extensionnya ga sesuai sama input-nya harusnya ";
                     cout << RESET BRIGHT_GREEN << inputExtension << BRIGHT_WHITE ITALIC << ", coba lagi yaa..." << endl << endl;
@@ -852,6 +851,352 @@ class IOHandler {
             this -> gifPath = convertPath(path);
         }
 
+        /**
+         * @brief Parse a whole string as a number, rejecting trailing characters
+         * @param input String to parse
+         * @param value Output parsed value
+         * @return True if the whole string is a valid number
+         */
+        bool parseNumber(const string& input, double& value) {
+            try {
+                size_t parsed = 0;
+                value = stod(input, &parsed);
+                return parsed == input.length();
+            }
+            catch (const std::exception& e) {
+                return false;
+            }
+        }
+
+        /**
+         * @brief Check that the directory of an output path exists
+         * @param path Output file path
+         * @return True if the directory exists
+         */
+        bool isValidDirectory(const string& path) {
+            std::filesystem::path directory = std::filesystem::path(path).parent_path();
+            return directory.empty() || std::filesystem::is_directory(directory);
+        }
+
+        /**
+         * @brief Parse and validate the command-line flags without any prompt
+         * @param argc Argument count
+         * @param argv Argument values
+         * @return Empty string if valid, error message if invalid
+         */
+        string parseArguments(int argc, char* argv[]) {
+            string modeInput, thresholdInput, minBlockInput, targetInput, jobsInput, estimateInput;
+            string layoutInput, maxDepthInput, maxBytesInput, memoryInput, tileInput, formatInput, repeatInput;
+            double value;
+
+            for (int i = 1; i < argc; i++) {
+                string flag = argv[i];
+
+                if (flag == "-h" || flag == "--help") {
+                    helpRequested = true;
+                    return "";
+                }
+
+                if (i + 1 >= argc) return "Flag " + flag + " butuh value.";
+                string input = argv[++i];
+
+                if (flag == "-i" || flag == "--input") inputPath = input;
+                else if (flag == "-m" || flag == "--mode") modeInput = input;
+                else if (flag == "-t" || flag == "--threshold") thresholdInput = input;
+                else if (flag == "-b" || flag == "--min-block") minBlockInput = input;
+                else if (flag == "-p" || flag == "--target") targetInput = input;
+                else if (flag == "-o" || flag == "--output") outputPath = input;
+                else if (flag == "-g" || flag == "--gif") gifPath = input;
+                else if (flag == "-B" || flag == "--batch") batchPath = input;
+                else if (flag == "-d" || flag == "--output-dir") outputDir = input;
+                else if (flag == "-j" || flag == "--jobs") jobsInput = input;
+                else if (flag == "-e" || flag == "--estimate") estimateInput = input;
+                else if (flag == "-D" || flag == "--decode") decodePath = input;
+                else if (flag == "-l" || flag == "--layout") layoutInput = input;
+                else if (flag == "-k" || flag == "--max-depth") maxDepthInput = input;
+                else if (flag == "-z" || flag == "--max-bytes") maxBytesInput = input;
+                else if (flag == "-M" || flag == "--memory") memoryInput = input;
+                else if (flag == "-T" || flag == "--tile") tileInput = input;
+                else if (flag == "-R" || flag == "--bench") benchPath = input;
+                else if (flag == "-f" || flag == "--format") formatInput = input;
+                else if (flag == "-r" || flag == "--repeat") repeatInput = input;
+                else if (flag == "-S" || flag == "--stats") statsPath = input;
+                else return "Flag " + flag + " ga dikenal.";
+            }
+
+            // Size estimation of the target search
+            if (!estimateInput.empty()) {
+                if (estimateInput != "fast" && estimateInput != "confirm") return "Estimate harus fast atau confirm.";
+                estimateSize = true;
+                confirmSize = estimateInput == "confirm";
+            }
+
+            // Stats follow a single compression from decoding its input to measuring its output
+            if (!statsPath.empty() && (!decodePath.empty() || !benchPath.empty() || !batchPath.empty())) {
+                return "Flag --stats cuma bisa dipakai buat kompresi satu image.";
+            }
+
+            // Decoding only needs the .qtz input, the image output, and the limits of a partial decode
+            if (!maxDepthInput.empty()) {
+                if (!parseNumber(maxDepthInput, value) || value != static_cast<int>(value) || value < 0) return "Max depth harus bilangan bulat positif.";
+                maxDepth = static_cast<int>(value);
+            }
+            if (!maxBytesInput.empty()) {
+                if (!parseNumber(maxBytesInput, value) || value != static_cast<long long>(value) || value <= 0) return "Max bytes harus bilangan bulat positif.";
+                maxBytes = static_cast<size_t>(value);
+            }
+            if (!decodePath.empty()) return parseDecodeArguments();
+            if (!maxDepthInput.empty() || !maxBytesInput.empty()) return "Flag --max-depth dan --max-bytes cuma bisa dipakai bareng --decode.";
+
+            // Layout of a .qtz output
+            if (!layoutInput.empty()) {
+                if (layoutInput != "preorder" && layoutInput != "level") return "Layout harus preorder atau level.";
+                levelLayout = layoutInput == "level";
+            }
+
+            // Memory mode, read by the image loader and the error methods
+            if (!memoryInput.empty()) {
+                if (memoryInput != "normal" && memoryInput != "low") return "Memory harus normal atau low.";
+                lowMemory = memoryInput == "low";
+                ctx.lowMemory = lowMemory;
+            }
+
+            // Tiles are quadtree regions, at least a histogram node so the regions above them are measured like the whole image
+            if (!tileInput.empty()) {
+                if (!parseNumber(tileInput, value) || value != static_cast<int>(value) || value < QuadTree::MIN_TILE_SIZE) {
+                    return "Tile size harus bilangan bulat minimal " + to_string(QuadTree::MIN_TILE_SIZE) + ".";
+                }
+                tileSize = static_cast<int>(value);
+            }
+
+            // The benchmark picks its own modes and thresholds
+            if (!benchPath.empty()) return parseBenchArguments(minBlockInput, jobsInput, formatInput, repeatInput, tileInput);
+            if (!formatInput.empty() || !repeatInput.empty()) return "Flag --format dan --repeat cuma bisa dipakai bareng --bench.";
+
+            // Batch mode validates the shared parameters only, each image is checked by its worker
+            if (!batchPath.empty()) return parseBatchArguments(modeInput, thresholdInput, minBlockInput, targetInput, jobsInput);
+
+            // Quadtree build threads
+            if (!jobsInput.empty()) {
+                if (!parseNumber(jobsInput, value) || !(value >= 0 && value <= MAX_JOBS) || value != static_cast<int>(value)) {
+                    return "Jumlah jobs harus bilangan bulat tidak negatif (0 = semua thread), maksimal " + to_string(MAX_JOBS) + ".";
+                }
+                jobs = static_cast<int>(value);
+            }
+
+            // Input path
+            if (inputPath.empty()) return "Flag --input wajib diisi.";
+            inputPathDisplay = inputPath;
+            inputPath = convertPath(inputPath);
+            inputExtension = getExtension(inputPath);
+
+            vector<string> allowedExtensions = {"jpg", "jpeg", "png"};
+            if (find(allowedExtensions.begin(), allowedExtensions.end(), inputExtension) == allowedExtensions.end()) {
+                return "Extension input harus .jpg, .jpeg, atau .png.";
+            }
+            if (!std::filesystem::is_regular_file(inputPath)) return "Ga ada file image-nya: " + inputPathDisplay;
+
+            // Mode
+            if (modeInput.empty()) return "Flag --mode wajib diisi.";
+            if (!parseNumber(modeInput, value) || value != static_cast<int>(value) || value < 1 || value > 5) {
+                return "Mode harus angka 1 sampai 5.";
+            }
+            mode = static_cast<int>(value);
+            ErrorMethod::getThresholdRange(mode, lowerThreshold, upperThreshold);
+
+            // Target percentage
+            if (!targetInput.empty()) {
+                if (!parseNumber(targetInput, targetPercentage) || targetPercentage < 0.0 || targetPercentage > 1.0) {
+                    return "Target harus di rentang 0.0 sampai 1.0.";
+                }
+            }
+
+            // Threshold, only optional when the target percentage decides it
+            if (estimateSize && targetPercentage == 0) return "Flag --estimate cuma bisa dipakai bareng --target.";
+            if (tileSize > 0 && targetPercentage != 0) return "Flag --tile ga bisa dipakai bareng --target.";
+            if (thresholdInput.empty()) {
+                if (targetPercentage == 0) return "Flag --threshold wajib diisi kalau --target ga dipakai.";
+            }
+            else if (!parseNumber(thresholdInput, threshold) || threshold < lowerThreshold || threshold > upperThreshold) {
+                return "Threshold harus di rentang " + to_string(lowerThreshold) + " - " + to_string(upperThreshold) + ".";
+            }
+
+            // Minimum block size
+            if (minBlockInput.empty()) return "Flag --min-block wajib diisi.";
+            if (!parseNumber(minBlockInput, value) || value != static_cast<long long>(value) || value <= 0) {
+                return "Minimum block size harus bilangan bulat positif.";
+            }
+
+            // Output path
+            if (outputPath.empty()) return "Flag --output wajib diisi.";
+            outputPathDisplay = outputPath;
+            outputPath = convertPath(outputPath);
+            if (getExtension(outputPath) != inputExtension && getExtension(outputPath) != "qtz") {
+                return "Extension output harus sama dengan input (" + inputExtension + ") atau .qtz.";
+            }
+            if (!isValidDirectory(outputPath)) return "Direktori output-nya engga ada: " + outputPathDisplay;
+            if (levelLayout && getExtension(outputPath) != "qtz") return "Flag --layout cuma bisa dipakai buat output .qtz.";
+            if (tileSize > 0 && getExtension(outputPath) == "qtz") return "Flag --tile ga nyimpen quadtree-nya, ga bisa buat output .qtz.";
+
+            // GIF path, optional
+            if (!gifPath.empty()) {
+                gifPathDisplay = gifPath;
+                gifPath = convertPath(gifPath);
+                if (getExtension(gifPath) != "gif") return "Extension GIF harus .gif.";
+                if (!isValidDirectory(gifPath)) return "Direktori GIF-nya engga ada: " + gifPathDisplay;
+                if (lowMemory && targetPercentage != 0) return "Flag --gif bareng --target butuh image aslinya, ga bisa di --memory low.";
+                if (tileSize > 0) return "Flag --gif butuh image utuh, ga bisa bareng --tile.";
+            }
+
+            // Stats output, the image context collects them from the decoding on
+            if (!statsPath.empty()) {
+                string statsPathDisplay = statsPath;
+                statsPath = convertPath(statsPath);
+                if (getExtension(statsPath) != "json") return "Extension stats harus .json.";
+                if (!isValidDirectory(statsPath)) return "Direktori stats-nya engga ada: " + statsPathDisplay;
+                ctx.stats = &stats;
+            }
+
+            // Load image last, so invalid flags fail before any decoding work
+            string loadError = Image::loadImage(ctx, inputPath, inputExtension);
+            if (!loadError.empty()) return loadError;
+
+            if (value > (double)ctx.imgWidth * ctx.imgHeight) {
+                return "Minimum block size ga boleh lebih dari luas image (" + to_string(ctx.imgWidth * ctx.imgHeight) + " px).";
+            }
+            minBlock = static_cast<int>(value);
+
+            return "";
+        }
+
+        /**
+         * @brief Validate the flags of a benchmark run
+         * @param minBlockInput Minimum block size flag value
+         * @param jobsInput Quadtree build thread count flag value
+         * @param formatInput Report format flag value
+         * @param repeatInput Runs per case flag value
+         * @param tileInput Tile size flag value
+         * @return Empty string if valid, error message if invalid
+         */
+        string parseBenchArguments(const string& minBlockInput, const string& jobsInput, const string& formatInput, const string& repeatInput, const string& tileInput) {
+            double value;
+
+            if (!inputPath.empty() || !outputPath.empty() || !gifPath.empty() || !batchPath.empty()) {
+                return "Flag --bench cuma bisa dipakai bareng --min-block, --jobs, --memory, --output-dir, --format, dan --repeat.";
+            }
+            if (!tileInput.empty()) return "Flag --tile ga bisa dipakai bareng --bench, case --target-nya butuh image utuh.";
+
+            if (!formatInput.empty()) {
+                if (formatInput != "csv" && formatInput != "json") return "Format harus csv atau json.";
+                benchFormat = formatInput;
+            }
+
+            if (!repeatInput.empty()) {
+                if (!parseNumber(repeatInput, value) || value != static_cast<int>(value) || value < 1) return "Repeat harus bilangan bulat positif.";
+                benchRepeat = static_cast<int>(value);
+            }
+
+            minBlock = 4;
+            if (!minBlockInput.empty()) {
+                if (!parseNumber(minBlockInput, value) || value != static_cast<int>(value) || value <= 0) {
+                    return "Minimum block size harus bilangan bulat positif.";
+                }
+                minBlock = static_cast<int>(value);
+            }
+
+            if (!jobsInput.empty()) {
+                if (!parseNumber(jobsInput, value) || !(value >= 0 && value <= MAX_JOBS) || value != static_cast<int>(value)) {
+                    return "Jumlah jobs harus bilangan bulat tidak negatif (0 = semua thread), maksimal " + to_string(MAX_JOBS) + ".";
+                }
+                jobs = static_cast<int>(value);
+            }
+
+            // Outputs of the cases are only written to be timed, by default somewhere they do not pile up
+            if (outputDir.empty()) outputDir = (std::filesystem::temp_directory_path() / "quadpressor-bench").string();
+            outputDir = convertPath(outputDir);
+            benchPath = convertPath(benchPath);
+            return "";
+        }
+
+        /**
+         * @brief Validate the flags of decoding a .qtz file
+         * @return Empty string if valid, error message if invalid
+         */
+        string parseDecodeArguments() {
+            if (!inputPath.empty() || !batchPath.empty() || !gifPath.empty()) return "Flag --decode cuma bisa dipakai bareng --output, --max-depth, dan --max-bytes.";
+
+            decodePath = convertPath(decodePath);
+            if (getExtension(decodePath) != "qtz") return "Extension decode harus .qtz.";
+            if (!std::filesystem::is_regular_file(decodePath)) return "Ga ada file .qtz-nya: " + decodePath;
+
+            if (outputPath.empty()) return "Flag --output wajib diisi.";
+            outputPathDisplay = outputPath;
+            outputPath = convertPath(outputPath);
+
+            vector<string> allowedExtensions = {"jpg", "jpeg", "png"};
+            if (find(allowedExtensions.begin(), allowedExtensions.end(), getExtension(outputPath)) == allowedExtensions.end()) {
+                return "Extension output harus .jpg, .jpeg, atau .png.";
+            }
+            if (!isValidDirectory(outputPath)) return "Direktori output-nya engga ada: " + outputPathDisplay;
+
+            return "";
+        }
+
+        /**
+         * @brief Validate the flags shared by every image of a batch
+         * @param modeInput Mode flag value
+         * @param thresholdInput Threshold flag value
+         * @param minBlockInput Minimum block size flag value
+         * @param targetInput Target percentage flag value
+         * @param jobsInput Worker thread count flag value
+         * @return Empty string if valid, error message if invalid
+         */
+        string parseBatchArguments(const string& modeInput, const string& thresholdInput, const string& minBlockInput, const string& targetInput, const string& jobsInput) {
+            double value;
+
+            if (!inputPath.empty() || !outputPath.empty()) return "Flag --input dan --output ga bisa dipakai bareng --batch, pakai --output-dir.";
+            if (!gifPath.empty()) return "Flag --gif ga didukung di batch mode.";
+
+            if (modeInput.empty()) return "Flag --mode wajib diisi.";
+            if (!parseNumber(modeInput, value) || value != static_cast<int>(value) || value < 1 || value > 5) {
+                return "Mode harus angka 1 sampai 5.";
+            }
+            mode = static_cast<int>(value);
+            ErrorMethod::getThresholdRange(mode, lowerThreshold, upperThreshold);
+
+            if (!targetInput.empty()) {
+                if (!parseNumber(targetInput, targetPercentage) || targetPercentage < 0.0 || targetPercentage > 1.0) {
+                    return "Target harus di rentang 0.0 sampai 1.0.";
+                }
+            }
+
+            if (estimateSize && targetPercentage == 0) return "Flag --estimate cuma bisa dipakai bareng --target.";
+            if (tileSize > 0 && targetPercentage != 0) return "Flag --tile ga bisa dipakai bareng --target.";
+            if (thresholdInput.empty()) {
+                if (targetPercentage == 0) return "Flag --threshold wajib diisi kalau --target ga dipakai.";
+            }
+            else if (!parseNumber(thresholdInput, threshold) || threshold < lowerThreshold || threshold > upperThreshold) {
+                return "Threshold harus di rentang " + to_string(lowerThreshold) + " - " + to_string(upperThreshold) + ".";
+            }
+
+            if (minBlockInput.empty()) return "Flag --min-block wajib diisi.";
+            if (!parseNumber(minBlockInput, value) || value != static_cast<int>(value) || value <= 0) {
+                return "Minimum block size harus bilangan bulat positif.";
+            }
+            minBlock = static_cast<int>(value);
+
+            if (!jobsInput.empty()) {
+                if (!parseNumber(jobsInput, value) || !(value >= 0 && value <= MAX_JOBS) || value != static_cast<int>(value)) {
+                    return "Jumlah jobs harus bilangan bulat tidak negatif (0 = semua thread), maksimal " + to_string(MAX_JOBS) + ".";
+                }
+                jobs = static_cast<int>(value);
+            }
+
+            batchPath = convertPath(batchPath);
+            outputDir = convertPath(outputDir);
+            return "";
+        }
+
         /**
          * @brief Display the log messages for each step of the process
          * @param step The current step of the process
@@ -879,7 +1224,7 @@ class IOHandler {
             // Error method (mode)
             else if (step == 2) 
             {
-                cout << RESET GREEN BOLD << "[1/7]" << RESET BRIGHT_WHITE ITALIC << " Image: " << RESET BRIGHT_CYAN << getFilename(inputPathDisplay) << BRIGHT_YELLOW << " (" << imgWidth << " x " << imgHeight << ") ";
+                cout << RESET GREEN BOLD << "[1/7]" << RESET BRIGHT_WHITE ITALIC << " Image: " << RESET BRIGHT_CYAN << getFilename(inputPathDisplay) << BRIGHT_YELLOW << " (" << ctx.imgWidth << " x " << ctx.imgHeight << ") ";
                 cout << MAGENTA BOLD << fixed << setprecision(2) << Image::getSizeInKB(Image::getOriginalSize(inputPath)) << " KB" << BRIGHT_WHITE << ". Path: " << BRIGHT_CYAN << inputPathDisplay << endl;
                 cout << RESET GREEN BOLD << "[2/7]" << RESET BRIGHT_WHITE ITALIC << " Enter error measurement method..." << endl;
                 cout << endl;
@@ -895,7 +1240,7 @@ class IOHandler {
             // Threshold
             else if (step == 3)
             {
-                cout << RESET GREEN BOLD << "[1/7]" << RESET BRIGHT_WHITE ITALIC << " Image: " << RESET BRIGHT_CYAN << getFilename(inputPathDisplay) << BRIGHT_YELLOW << " (" << imgWidth << " x " << imgHeight << ") ";
+                cout << RESET GREEN BOLD << "[1/7]" << RESET BRIGHT_WHITE ITALIC << " Image: " << RESET BRIGHT_CYAN << getFilename(inputPathDisplay) << BRIGHT_YELLOW << " (" << ctx.imgWidth << " x " << ctx.imgHeight << ") ";
                 cout << MAGENTA BOLD << fixed << setprecision(2) << Image::getSizeInKB(Image::getOriginalSize(inputPath)) << " KB" << BRIGHT_WHITE << ". Path: " << BRIGHT_CYAN << inputPathDisplay << endl;
                 cout << RESET GREEN BOLD << "[2/7]" << RESET BRIGHT_WHITE ITALIC << " Error Measurement Method: " << RESET BRIGHT_CYAN << errorMethod << endl;
                 cout << RESET GREEN BOLD << "[3/7]" << RESET BRIGHT_WHITE ITALIC << " Enter threshold..." << endl;
@@ -908,14 +1253,14 @@ class IOHandler {
             // Minimum block size
             else if (step == 4)
             {
-                cout << RESET GREEN BOLD << "[1/7]" << RESET BRIGHT_WHITE ITALIC << " Image: " << RESET MAGENTA << getFilename(inputPathDisplay) << BRIGHT_YELLOW << " (" << imgWidth << " x " << imgHeight << ") ";
+                cout << RESET GREEN BOLD << "[1/7]" << RESET BRIGHT_WHITE ITALIC << " Image: " << RESET MAGENTA << getFilename(inputPathDisplay) << BRIGHT_YELLOW << " (" << ctx.imgWidth << " x " << ctx.imgHeight << ") ";
                 cout << MAGENTA BOLD << fixed << setprecision(2) << Image::getSizeInKB(Image::getOriginalSize(inputPath)) << " KB" << BRIGHT_WHITE << ". Path: " << BRIGHT_CYAN << inputPathDisplay << endl;
                 cout << RESET GREEN BOLD << "[2/7]" << RESET BRIGHT_WHITE ITALIC << " Error Measurement Method: " << RESET BRIGHT_CYAN << errorMethod << endl;
                 cout << RESET GREEN BOLD << "[3/7]" << RESET BRIGHT_WHITE ITALIC << " Threshold: " << RESET BRIGHT_CYAN << threshold << endl;
                 cout << RESET GREEN BOLD << "[4/7]" << RESET BRIGHT_WHITE ITALIC << " Enter minimum block size..." << endl;
                 cout << endl;
                 
-                int maxBlockSize = imgWidth * imgHeight;
+                int maxBlockSize = ctx.imgWidth * ctx.imgHeight;
                 cout << RESET BRIGHT_CYAN BOLD << "[?]" << RESET BRIGHT_WHITE ITALIC << " Must not exceed the image area ";
                 cout << RESET BRIGHT_CYAN << "(" << maxBlockSize << " px)" << endl;
                 cout << RESET MAGENTA BOLD << "[-]" << RESET BRIGHT_WHITE ITALIC << " Example: " << RESET MAGENTA << "8" << endl;
@@ -924,7 +1269,7 @@ class IOHandler {
             // Target percentage
             else if (step == 5)
             {
-                cout << RESET GREEN BOLD << "[1/7]" << RESET BRIGHT_WHITE ITALIC << " Image: " << RESET BRIGHT_CYAN << getFilename(inputPathDisplay) << BRIGHT_YELLOW << " (" << imgWidth << " x " << imgHeight << ") ";
+                cout << RESET GREEN BOLD << "[1/7]" << RESET BRIGHT_WHITE ITALIC << " Image: " << RESET BRIGHT_CYAN << getFilename(inputPathDisplay) << BRIGHT_YELLOW << " (" << ctx.imgWidth << " x " << ctx.imgHeight << ") ";
                 cout << MAGENTA BOLD << fixed << setprecision(2) << Image::getSizeInKB(Image::getOriginalSize(inputPath)) << " KB" << BRIGHT_WHITE << ". Path: " << BRIGHT_CYAN << inputPathDisplay << endl;
                 cout << RESET GREEN BOLD << "[2/7]" << RESET BRIGHT_WHITE ITALIC << " Error Measurement Method: " << RESET BRIGHT_CYAN << errorMethod << endl;
                 cout << RESET GREEN BOLD << "[3/7]" << RESET BRIGHT_WHITE ITALIC << " Threshold: " << RESET BRIGHT_CYAN << threshold << endl;
@@ -940,7 +1285,7 @@ class IOHandler {
             // Output image path
             else if (step == 6)
             {
-                cout << RESET GREEN BOLD << "[1/7]" << RESET BRIGHT_WHITE ITALIC << " Image: " << RESET BRIGHT_CYAN << getFilename(inputPathDisplay) << BRIGHT_YELLOW << " (" << imgWidth << " x " << imgHeight << ") ";
+                cout << RESET GREEN BOLD << "[1/7]" << RESET BRIGHT_WHITE ITALIC << " Image: " << RESET BRIGHT_CYAN << getFilename(inputPathDisplay) << BRIGHT_YELLOW << " (" << ctx.imgWidth << " x " << ctx.imgHeight << ") ";
                 cout << MAGENTA BOLD << fixed << setprecision(2) << Image::getSizeInKB(Image::getOriginalSize(inputPath)) << " KB" << BRIGHT_WHITE << ". Path: " << BRIGHT_CYAN << inputPathDisplay << endl;
                 cout << RESET GREEN BOLD << "[2/7]" << RESET BRIGHT_WHITE ITALIC << " Error Measurement Method: " << RESET BRIGHT_CYAN << errorMethod << endl;
                 cout << RESET GREEN BOLD << "[3/7]" << RESET BRIGHT_WHITE ITALIC << " Threshold: " << RESET BRIGHT_CYAN << threshold << endl;
@@ -953,7 +1298,7 @@ class IOHandler {
                 cout << RESET GREEN BOLD << "[6/7]" << RESET BRIGHT_WHITE ITALIC << " Enter image output path..."<<endl;
                 cout << endl;
         
-                cout << RESET BRIGHT_CYAN BOLD << "[?]" << RESET BRIGHT_WHITE ITALIC << " Output extension must be the same as input. Example: " << endl;
+                cout << RESET BRIGHT_CYAN BOLD << "[?]" << RESET BRIGHT_WHITE ITALIC << " Output extension must be the same as input, or .qtz for the quadtree itself. Example: " << endl;
                 cout << RESET MAGENTA BOLD << "[-]" << RESET BRIGHT_YELLOW << " D:\\bla-bla-bla\\example_out.jpg" << RESET ITALIC BRIGHT_WHITE << " for " << RESET BRIGHT_CYAN << "Windows" << endl;
                 cout << RESET MAGENTA BOLD << "[-]" << RESET BRIGHT_YELLOW << " /home/<user>/example_out.jpg" << RESET ITALIC BRIGHT_WHITE << " for " << RESET BRIGHT_CYAN << "Linux" << endl;
                 cout << RESET MAGENTA BOLD << "[-]" << RESET BRIGHT_YELLOW << " /home/<user>/example_out.jpg" << RESET ITALIC BRIGHT_WHITE << " or";
@@ -963,7 +1308,7 @@ class IOHandler {
             // Output GIF path
             else if (step == 7)
             {
-                cout << RESET GREEN BOLD << "[1/7]" << RESET BRIGHT_WHITE ITALIC << " Image: " << RESET BRIGHT_CYAN << getFilename(inputPathDisplay) << BRIGHT_YELLOW << " (" << imgWidth << " x " << imgHeight << ") ";
+                cout << RESET GREEN BOLD << "[1/7]" << RESET BRIGHT_WHITE ITALIC << " Image: " << RESET BRIGHT_CYAN << getFilename(inputPathDisplay) << BRIGHT_YELLOW << " (" << ctx.imgWidth << " x " << ctx.imgHeight << ") ";
                 cout << MAGENTA BOLD << fixed << setprecision(2) << Image::getSizeInKB(Image::getOriginalSize(inputPath)) << " KB" << BRIGHT_WHITE << ". Path: " << BRIGHT_CYAN << inputPathDisplay << endl;
                 cout << RESET GREEN BOLD << "[2/7]" << RESET BRIGHT_WHITE ITALIC << " Error Measurement Method: " << RESET BRIGHT_CYAN << errorMethod << endl;
                 cout << RESET GREEN BOLD << "[3/7]" << RESET BRIGHT_WHITE ITALIC << " Threshold: " << RESET BRIGHT_CYAN << threshold << endl;
@@ -987,7 +1332,7 @@ class IOHandler {
             // Complete
             else if (step == 8)
             {
-                cout << RESET GREEN BOLD << "[1/7]" << RESET BRIGHT_WHITE ITALIC << " Image: " << RESET BRIGHT_CYAN << getFilename(inputPathDisplay) << BRIGHT_YELLOW << " (" << imgWidth << " x " << imgHeight << ") ";
+                cout << RESET GREEN BOLD << "[1/7]" << RESET BRIGHT_WHITE ITALIC << " Image: " << RESET BRIGHT_CYAN << getFilename(inputPathDisplay) << BRIGHT_YELLOW << " (" << ctx.imgWidth << " x " << ctx.imgHeight << ") ";
                 cout << MAGENTA BOLD << fixed << setprecision(2) << Image::getSizeInKB(Image::getOriginalSize(inputPath)) << " KB" << BRIGHT_WHITE << ". Path: " << BRIGHT_CYAN << inputPathDisplay << endl;
                 cout << RESET GREEN BOLD << "[2/7]" << RESET BRIGHT_WHITE ITALIC << " Error Method Measurement: " << RESET BRIGHT_CYAN << errorMethod << endl;
                 cout << RESET GREEN BOLD << "[3/7]" << RESET BRIGHT_WHITE ITALIC << " Threshold: " << RESET BRIGHT_CYAN << threshold << endl;
@@ -1008,8 +1353,9 @@ class IOHandler {
     public:
         /**
          * @brief Constructor that validates all required inputs
+         * @param ctx Image context that receives the loaded input image
          */
-        IOHandler() {
+        IOHandler(ImageContext& ctx) : ctx(ctx) {
             validateInputPath();
             validateMode();
             validateThreshold();
@@ -1020,6 +1366,31 @@ class IOHandler {
             showLog(8); 
         }
 
+        /**
+         * @brief Constructor that reads all required inputs from command-line flags, without prompts or styling
+         * @param ctx Image context that receives the loaded input image
+         * @param argc Argument count
+         * @param argv Argument values
+         */
+        IOHandler(ImageContext& ctx, int argc, char* argv[]) : ctx(ctx) {
+            mode = 0;
+            minBlock = 0;
+            threshold = 0;
+            targetPercentage = 0;
+            helpRequested = false;
+            jobs = 0;
+            estimateSize = false;
+            confirmSize = false;
+            levelLayout = false;
+            maxDepth = INT_MAX;
+            maxBytes = SIZE_MAX;
+            lowMemory = false;
+            tileSize = 0;
+            benchFormat = "csv";
+            benchRepeat = 1;
+            errorMessage = parseArguments(argc, argv);
+        }
+
         /**
          * @brief Destructor
          */
@@ -1073,6 +1444,182 @@ class IOHandler {
          */
         string getGifPath() {return gifPath;}
 
+        /**
+         * @brief Get the validation error of the command-line flags
+         * @return Error message, empty if all flags are valid
+         */
+        string getErrorMessage() {return errorMessage;}
+
+        /**
+         * @brief Check whether only the command-line usage was requested
+         * @return True if --help was given
+         */
+        bool isHelpRequested() {return helpRequested;}
+
+        /**
+         * @brief Get the directory or manifest of images for batch mode
+         * @return Batch source path, empty for a single image
+         */
+        string getBatchPath() {return batchPath;}
+
+        /**
+         * @brief Get the output directory for batch mode
+         * @return Output directory
+         */
+        string getOutputDir() {return outputDir;}
+
+        /**
+         * @brief Get the .qtz file to decode
+         * @return Decode source path, empty to compress
+         */
+        string getDecodePath() {return decodePath;}
+
+        /**
+         * @brief Get the directory or manifest of images to benchmark
+         * @return Benchmark source, empty to compress
+         */
+        string getBenchPath() {return benchPath;}
+
+        /**
+         * @brief Get the format of the benchmark report
+         * @return csv or json
+         */
+        string getBenchFormat() {return benchFormat;}
+
+        /**
+         * @brief Get the number of runs of every benchmark case
+         * @return Runs per case
+         */
+        int getBenchRepeat() {return benchRepeat;}
+
+        /**
+         * @brief Get the output JSON path of the phase times and counters
+         * @return Stats path, empty if none are collected
+         */
+        string getStatsPath() {return statsPath;}
+
+        /**
+         * @brief Get the phase times and counters of the compression, filled while it runs
+         * @return Stats of the compression
+         */
+        const CompressionStats& getStats() {return stats;}
+
+        /**
+         * @brief Check whether a .qtz output is laid out level by level
+         * @return True if --layout level was given
+         */
+        bool isLevelLayout() {return levelLayout;}
+
+        /**
+         * @brief Get the deepest level decoded from a level-by-level .qtz file
+         * @return Maximum depth, INT_MAX for every level
+         */
+        int getMaxDepth() {return maxDepth;}
+
+        /**
+         * @brief Get the bytes decoded at most from a level-by-level .qtz file
+         * @return Byte budget, SIZE_MAX for the whole file
+         */
+        size_t getMaxBytes() {return maxBytes;}
+
+        /**
+         * @brief Check whether images are compressed in low-memory mode
+         * @return True if --memory low was given
+         */
+        bool isLowMemory() {return lowMemory;}
+
+        /**
+         * @brief Get the side of a tile of a tiled compression
+         * @return Tile size in pixels, 0 to compress the whole image at once
+         */
+        int getTileSize() {return tileSize;}
+
+        /**
+         * @brief Get the peak resident memory of the process so far
+         * @return Peak resident set size in kilobytes, 0 if unknown
+         */
+        static long long getPeakMemoryKB() {
+#ifdef _WIN32
+            PROCESS_MEMORY_COUNTERS counters;
+            if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+            return counters.PeakWorkingSetSize / 1024;
+#else
+            struct rusage usage;
+            if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+            return usage.ru_maxrss / 1024;
+#else
+            return usage.ru_maxrss;
+#endif
+#endif
+        }
+
+        /**
+         * @brief Start measuring the peak resident memory again from the current usage, where the system allows it
+         * @return True if the peak was reset, false if it keeps counting from the start of the process
+         */
+        static bool resetPeakMemory() {
+#ifdef __linux__
+            FILE* file = fopen("/proc/self/clear_refs", "w");
+            if (!file) return false;
+            bool written = fputs("5", file) >= 0;
+            return fclose(file) == 0 && written;
+#else
+            return false;
+#endif
+        }
+
+        /**
+         * @brief Get the number of batch worker threads, or of quadtree build threads for a single image
+         * @return Worker thread count, 0 for every hardware thread
+         */
+        int getJobs() {return jobs;}
+
+        /**
+         * @brief Check whether the target search predicts encoded sizes
+         * @return True if --estimate was given
+         */
+        bool isEstimateSize() {return estimateSize;}
+
+        /**
+         * @brief Check whether the predicted threshold is confirmed with real encodes
+         * @return True if --estimate confirm was given
+         */
+        bool isConfirmSize() {return confirmSize;}
+
+        /**
+         * @brief Print the command-line usage
+         */
+        static void showUsage() {
+            cout << "Usage: main -i <input> -m <1-5> -t <threshold> -b <min-block> -o <output> [options]" << endl;
+            cout << "       main -B <dir|manifest> -d <output-dir> -m <1-5> -t <threshold> -b <min-block> [options]" << endl;
+            cout << "       main -D <input.qtz> -o <output> [-k <depth>] [-z <bytes>]" << endl;
+            cout << "       main -R <dir|manifest> [-f csv|json] [-r <n>] [options]" << endl;
+            cout << endl;
+            cout << "  -i, --input <path>       Input image (.jpg, .jpeg, .png)" << endl;
+            cout << "  -m, --mode <1-5>         1 Variance, 2 MAD, 3 MPD, 4 Entropy, 5 SSIM" << endl;
+            cout << "  -t, --threshold <value>  Error threshold, optional when --target is set" << endl;
+            cout << "  -b, --min-block <px>     Minimum block area" << endl;
+            cout << "  -p, --target <0.0-1.0>   Target compression percentage, 0 to disable" << endl;
+            cout << "  -o, --output <path>      Output image, same extension as input, or .qtz for the quadtree itself" << endl;
+            cout << "  -g, --gif <path>         Output GIF visualization, skipped if not set" << endl;
+            cout << "  -B, --batch <path>       Directory of images, or manifest with one \"input[<TAB>output]\" per line" << endl;
+            cout << "  -d, --output-dir <path>  Output directory for batch mode" << endl;
+            cout << "  -j, --jobs <n>           Worker threads (batch images, or quadtree build), 0 or default every hardware thread, max 1024" << endl;
+            cout << "  -e, --estimate <mode>    Target search predicts sizes, fast or confirm (real encode of the result)" << endl;
+            cout << "  -M, --memory <mode>      normal, or low to keep one image buffer and the smallest error tables" << endl;
+            cout << "  -T, --tile <px>          Compress tiles of about px x px on their own, same result, memory bound by the tile (min 64)" << endl;
+            cout << "  -S, --stats <path.json>  Write the time of every phase and the node and pixel counters as JSON" << endl;
+            cout << "  -l, --layout <layout>    Layout of a .qtz output, preorder (default) or level for partial decoding" << endl;
+            cout << "  -D, --decode <path>      Decode a .qtz file into the output image (.jpg, .jpeg, .png)" << endl;
+            cout << "  -R, --bench <path>       Benchmark every mode, several thresholds, and --target 0.5 over a directory or manifest" << endl;
+            cout << "  -f, --format <format>    Benchmark report format, csv (default) or json" << endl;
+            cout << "  -r, --repeat <n>         Runs of every benchmark case, the fastest is reported" << endl;
+            cout << "  -k, --max-depth <n>      Decode the levels of a level .qtz down to depth n only" << endl;
+            cout << "  -z, --max-bytes <n>      Decode the whole levels within the first n bytes of a level .qtz only" << endl;
+            cout << "  -h, --help               Show this message" << endl;
+        }
+
         /**
          * @brief Shows the loading animation while compressing process
          */
@@ -9,36 +9,33 @@
 #include "../libs/style.h"
 #include "../libs/stb_image.h"
 #include "../libs/stb_image_write.h"
+#include "ImageContext.hpp"
 #include <vector>
 #include <iomanip>
+#include <iostream>
 #include <string>
 #include <algorithm>
-
-/**
- * @brief Image data buffers used throughout the compression process
- * @param currImgData Current image data buffer used for processing
- * @param initImgData Initial image data buffer kept as reference
- * @param tempImgData Temporary image data buffer for intermediate processing
- */
-extern unsigned char* currImgData, *initImgData, *tempImgData;
-
-/**
- * @brief Global image dimensions and format information
- * @param imgWidth Width of the image in pixels
- * @param imgHeight Height of the image in pixels
- * @param imgChannels Number of color channels (typically 3 for RGB, 4 for RGBA)
- * @param compressionQuality Adaptive compression quality for stb_image_write JPG/JPEG encoding
- */
-int imgWidth, imgHeight, imgChannels, compressionQuality;
+#include <filesystem>
+#include <map>
+#include <mutex>
 
 using namespace std;
 
 /**
  * @brief Static utility class for image operations
+ * @param PROXY_PIXELS Pixels of the sample a large image calibrates its JPG quality on
+ * @param PROXY_BLOCK Side of a JPG block with subsampled chroma, the height of a run of the sample
+ * @param PROXY_RUN Width of a run of the sample, several blocks so most blocks keep their left neighbor
+ * @param PROXY_WIDTH Width of the sample
  */
 class Image {
     
     public:
+        static constexpr long long PROXY_PIXELS = 1 << 18;
+        static constexpr int PROXY_BLOCK = 16;
+        static constexpr int PROXY_RUN = 8 * PROXY_BLOCK;
+        static constexpr int PROXY_WIDTH = 8 * PROXY_RUN;
+
         /**
          * @brief Callback function for stbi_write functions
          * @param context Pointer to context (size variable)
@@ -101,60 +98,165 @@ class Image {
             return static_cast<double>(sizeInBytes) / 1024.0;
         }
 
+        /**
+         * @brief Load an already decoded image from memory, without any file access
+         * @param ctx Image context that receives the buffers and dimensions
+         * @param pixels Interleaved 8-bit pixel data, row-major without padding
+         * @param width Width of the image in pixels
+         * @param height Height of the image in pixels
+         * @param channels Number of color channels (3 for RGB, 4 for RGBA)
+         * @param quality JPG/JPEG quality used when the result is encoded
+         * @return Empty string if successful, error message if failed
+         */
+        static string loadImageFromMemory(ImageContext& ctx, const unsigned char* pixels, int width, int height, int channels, int quality = 90) {
+
+            if (!pixels || width <= 0 || height <= 0) {
+                return "Buffer image-nya kosong.";
+            }
+
+            if (channels < 3 || channels > 4) {
+                return "Image-nya harus 3 atau 4 channel, kok ini " + to_string(channels) + " channel.";
+            }
+
+            ctx.imgWidth = width;
+            ctx.imgHeight = height;
+            ctx.imgChannels = channels;
+            ctx.compressionQuality = quality;
+
+            size_t imageSize = (size_t)width * height * channels;
+
+            // The temporary buffer is only needed for GIF frames, which in-memory compression never writes
+            ctx.currImgData = (unsigned char*) malloc(imageSize);
+            ctx.initImgData = (unsigned char*) malloc(imageSize);
+            if (!ctx.currImgData || !ctx.initImgData) {
+                ctx.freeImageData();
+                return "Gagal alokasi memori, coba ulang ya.";
+            }
+
+            memcpy(ctx.currImgData, pixels, imageSize);
+            memcpy(ctx.initImgData, pixels, imageSize);
+
+            return ""; // No error
+        }
+
         /**
          * @brief Load an image from file into memory
+         * @param ctx Image context that receives the buffers and dimensions
          * @param path Path to the image file
          * @param extension File extension/format
          * @return Empty string if successful, error message if failed
          */
-        static string loadImage(string path, string extension) {
+        static string loadImage(ImageContext& ctx, string path, string extension) {
             
-            currImgData = stbi_load(path.c_str(), &imgWidth, &imgHeight, &imgChannels, 0);
-            
-            if (imgChannels < 3) {
-                return "Image-nya harus ada minimal 3 channel (RGB), kok ini cuma " + to_string(imgChannels) + " channel doang.";
+            {
+                CompressionStats::Timer timer(ctx.stats, CompressionStats::DECODE);
+                ctx.currImgData = stbi_load(path.c_str(), &ctx.imgWidth, &ctx.imgHeight, &ctx.imgChannels, 0);
             }
             
-            if (!currImgData) {
+            if (!ctx.currImgData) {
                 return "Image-nya gagal di-load, coba ulang ya...";
             }
-            
-            // Allocate memory for backup copies
-            initImgData = (unsigned char*) malloc(imgWidth * imgHeight * imgChannels);
-            if (!initImgData) {
-                return "Gagal alokasi memori, coba ulang ya.";
+
+            if (ctx.imgChannels < 3) {
+                return "Image-nya harus ada minimal 3 channel (RGB), kok ini cuma " + to_string(ctx.imgChannels) + " channel doang.";
             }
 
-            memcpy(initImgData, currImgData, imgWidth * imgHeight * imgChannels);
+            size_t imageSize = (size_t)ctx.imgWidth * ctx.imgHeight * ctx.imgChannels;
+            
+            // The backup copy is only needed to rebuild the GIF of a target search, low-memory mode keeps the decoded buffer alone
+            if (!ctx.lowMemory) {
+                ctx.initImgData = (unsigned char*) malloc(imageSize);
+                if (!ctx.initImgData) {
+                    return "Gagal alokasi memori, coba ulang ya.";
+                }
+
+                memcpy(ctx.initImgData, ctx.currImgData, imageSize);
+            }
 
             if (extension != "png") {
-                int originalSize = getOriginalSize(path);
-
-                compressionQuality = 50;
-                int l = 5, r = 100;
-                while (l <= r) {
-                    int mid = (l+r)/2;
-
-                    int curSize = getEncodedSize(initImgData, imgWidth, imgHeight, extension, imgChannels, mid);
-
-                    if (curSize <= originalSize) {
-                        compressionQuality = mid;
-                        l = mid+1;
-                    }
-                    else {
-                        r = mid-1;
-                    }
+                CompressionStats::Timer timer(ctx.stats, CompressionStats::CALIBRATION);
+                ctx.compressionQuality = calibrateQuality(ctx, path, extension);
+            }
+
+            return ""; // No error
+        }
+
+        /**
+         * @brief Find the highest JPG quality whose encoding of the image is no larger than its file, remembered per file
+         *        An image of more than 4 * PROXY_PIXELS is sampled instead, as runs of whole blocks at full resolution spread evenly over it,
+         *        and the scan of the sample is scaled up by the pixel count, so each probe encodes PROXY_PIXELS instead of the whole image
+         * @param ctx Image context with the decoded image
+         * @param path Path to the image file
+         * @param extension File extension/format
+         * @return Calibrated quality, 50 if no quality fits
+         */
+        static int calibrateQuality(const ImageContext& ctx, const string& path, const string& extension) {
+            static mutex cacheLock;
+            static map<string, int> cache;
+
+            // A file is the same input as long as its size and modification time are
+            std::error_code error;
+            std::filesystem::path file(path);
+            string key = std::filesystem::absolute(file, error).string() + "|" + to_string(std::filesystem::file_size(file, error));
+            key += "|" + to_string(std::filesystem::last_write_time(file, error).time_since_epoch().count());
+            {
+                lock_guard<mutex> lock(cacheLock);
+                auto cached = cache.find(key);
+                if (cached != cache.end()) return cached -> second;
+            }
+
+            int channels = ctx.imgChannels;
+            long long pixels = (long long)ctx.imgWidth * ctx.imgHeight;
+            long long runs = ctx.imgWidth / PROXY_RUN, blockRows = ctx.imgHeight / PROXY_BLOCK;
+            long long wanted = PROXY_PIXELS / (PROXY_RUN * PROXY_BLOCK);
+
+            // Sample every step-th run in reading order, packed PROXY_WIDTH / PROXY_RUN runs to a row of the sample
+            vector<unsigned char> proxy;
+            unsigned char* sample = ctx.currImgData;
+            int sampleWidth = ctx.imgWidth, sampleHeight = ctx.imgHeight;
+            if (pixels > 4 * PROXY_PIXELS && runs * blockRows >= wanted) {
+                long long step = runs * blockRows / wanted;
+                int perRow = PROXY_WIDTH / PROXY_RUN;
+                sampleWidth = PROXY_WIDTH;
+                sampleHeight = (int)(wanted / perRow) * PROXY_BLOCK;
+                proxy.resize((size_t)sampleWidth * sampleHeight * channels);
+
+                size_t runBytes = (size_t)PROXY_RUN * channels;
+                for (long long k = 0; k < wanted; k++) {
+                    long long run = k * step;
+                    const unsigned char* from = ctx.currImgData + ((size_t)(run / runs) * PROXY_BLOCK * ctx.imgWidth + (size_t)(run % runs) * PROXY_RUN) * channels;
+                    unsigned char* to = proxy.data() + ((size_t)(k / perRow) * PROXY_BLOCK * sampleWidth + (size_t)(k % perRow) * PROXY_RUN) * channels;
+                    for (int i = 0; i < PROXY_BLOCK; i++) memcpy(to + (size_t)i * sampleWidth * channels, from + (size_t)i * ctx.imgWidth * channels, runBytes);
                 }
+                sample = proxy.data();
             }
+            double scale = (double)pixels / ((long long)sampleWidth * sampleHeight);
 
-            tempImgData = (unsigned char*) malloc(imgWidth * imgHeight * imgChannels);
-            if (!tempImgData) {
-                free(initImgData);
-                return "Gagal alokasi memori, coba ulang ya.";
+            size_t originalSize = getOriginalSize(path);
+            int quality = 50;
+            int l = 5, r = 100;
+            while (l <= r) {
+                int mid = (l+r)/2;
+
+                // The headers and tables are paid once, only the scan grows with the image
+                size_t curSize = getEncodedSize(sample, sampleWidth, sampleHeight, extension, channels, mid);
+                if (sample != ctx.currImgData) {
+                    size_t headerSize = getEncodedSize(sample, 1, 1, extension, channels, mid);
+                    curSize = headerSize + (size_t)((curSize - min(curSize, headerSize)) * scale);
+                }
+
+                if (curSize <= originalSize) {
+                    quality = mid;
+                    l = mid+1;
+                }
+                else {
+                    r = mid-1;
+                }
             }
-            memcpy(tempImgData, currImgData, imgWidth * imgHeight * imgChannels);
 
-            return ""; // No error
+            lock_guard<mutex> lock(cacheLock);
+            cache[key] = quality;
+            return quality;
         }
 };
 
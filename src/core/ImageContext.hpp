@@ -0,0 +1,62 @@
+#ifndef IMAGECONTEXT_HPP
+#define IMAGECONTEXT_HPP
+
+// Libraries
+#include <stdlib.h>
+#include "Stats.hpp"
+
+class ErrorMethod;
+
+/**
+ * @brief Image and compression state of a single compression, passed explicitly so independent compressions share nothing
+ * @param currImgData Current image data buffer used for processing
+ * @param initImgData Initial image data buffer kept as reference, not kept in low-memory mode
+ * @param tempImgData Temporary image data buffer for GIF frames, only allocated when a GIF is written
+ * @param imgWidth Width of the image in pixels
+ * @param imgHeight Height of the image in pixels
+ * @param imgChannels Number of color channels (typically 3 for RGB, 4 for RGBA)
+ * @param compressionQuality Adaptive compression quality for stb_image_write JPG/JPEG encoding
+ * @param errorMethod Error calculation method built for this image, owned by the QuadTree that built it
+ * @param lowMemory Whether only the current image data is kept and the error method builds its smallest tables
+ * @param stats Phase times and counters of the compression, not owned, nullptr to collect none
+ */
+struct ImageContext {
+    unsigned char *currImgData = nullptr, *initImgData = nullptr, *tempImgData = nullptr;
+    int imgWidth = 0, imgHeight = 0, imgChannels = 0, compressionQuality = 0;
+    ErrorMethod *errorMethod = nullptr;
+    bool lowMemory = false;
+    CompressionStats *stats = nullptr;
+
+    ImageContext() = default;
+    ImageContext(const ImageContext&) = delete;
+    ImageContext& operator=(const ImageContext&) = delete;
+
+    /**
+     * @brief Destructor that frees the image data buffers
+     */
+    ~ImageContext() {
+        freeImageData();
+    }
+
+    /**
+     * @brief Free the image data buffers
+     */
+    void freeImageData() {
+        if (currImgData != nullptr) {
+            free(currImgData);
+            currImgData = nullptr;
+        }
+
+        if (initImgData != nullptr) {
+            free(initImgData);
+            initImgData = nullptr;
+        }
+
+        if (tempImgData != nullptr) {
+            free(tempImgData);
+            tempImgData = nullptr;
+        }
+    }
+};
+
+#endif
@@ -2,62 +2,81 @@
 #define QUADTREE_HPP
 
 // Libraries
-#include <queue>
-#include <time.h>
-#include "QuadTreeNode.hpp"
-
-/**
- * @brief Image data buffers used throughout the compression process
- * @param currImgData Current image data buffer used for processing
- * @param initImgData Initial image data buffer kept as reference
- * @param tempImgData Temporary image data buffer for intermediate processing
- */
-extern unsigned char* currImgData, *initImgData, *tempImgData;
-
-/**
- * @brief Global image dimensions and format information
- * @param imgWidth Width of the image in pixels
- * @param imgHeight Height of the image in pixels
- * @param imgChannels Number of color channels (typically 3 for RGB, 4 for RGBA)
- * @param compressionQuality Adaptive compression quality for stb_image_write JPG/JPEG encoding
- */
-extern int imgWidth, imgHeight, imgChannels, compressionQuality;
+#include <chrono>
+#include <climits>
+#include "QuadTreeCodec.hpp"
+#include "ThreadPool.hpp"
+#include "SizeEstimator.hpp"
+#include "GifEncoder.hpp"
 
 /**
  * @brief Main class for quadtree-based image compression
+ * @param PARALLEL_MIN_AREA Smallest region in pixels built as its own task by the parallel build
+ * @param STRIPE_ROWS Rows of a horizontal stripe painted as one task when the leaves are painted
+ * @param MIN_TILE_SIZE Smallest side of a tile in pixels, so every region above the tiles is a histogram node of the whole image
+ * @param ctx Image context being compressed
  * @param mode Error calculation mode (1-5)
  * @param minBlock Minimum block size in pixels
  * @param threshold Error threshold value
  * @param targetPercentage Target compression percentage (0-1)
  * @param inputPath Input image path
  * @param inputExtension Input image file extension
- * @param outputPath Output image path
+ * @param outputPath Output image path, a .qtz path stores the quadtree itself
+ * @param outputExtension Output image file extension
+ * @param levelLayout Whether a .qtz output is laid out level by level
  * @param gifPath Output GIF path
  * @param lastImg Flag for final image in compression process
  * @param root Root node of the quadtree
- * @param g GIF writer for visualization
- * @param data Buffer for GIF frames
+ * @param tree Nodes of the quadtree, kept after compression, during the threshold search every node down to the minimum block size
+ * @param leaves Indices in tree of the leaves to paint, painted in one pass once the tree is complete
+ * @param gif GIF writer for visualization, encoding frames in the background
+ * @param frameTop First row painted since the last GIF frame
+ * @param frameLeft First column painted since the last GIF frame
+ * @param frameBottom Row past the last row painted since the last GIF frame
+ * @param frameRight Column past the last column painted since the last GIF frame
+ * @param frameColors Colors painted since the last GIF frame as 0xRRGGBB
+ * @param threads Number of threads building the quadtree
+ * @param tileArea Largest tile in pixels of a tiled compression, 0 to compress the whole image at once
+ * @param estimateSize Whether the target search predicts encoded sizes instead of encoding every step
+ * @param confirmSize Whether the predicted threshold is confirmed with real encodes
  * @param startTime Compression start time
+ * @param outputTime Time the output of the final image started, when the quadtree was complete
  * @param endTime Compression end time
+ * @param measuredTime Time the final size was measured
  * @param initialSize Initial image size in bytes
  * @param finalSize Final compressed image size in bytes
  * @param compressionPercentage Achieved compression percentage
  * @param quadtreeDepth Maximum depth of the quadtree
  * @param quadtreeNode Number of nodes in the quadtree
+ * @param errorMessage Error that stopped the compression, empty if it succeeded
  */
 class QuadTree {
 
     private:
+        struct Subtree {
+            vector<QuadTreeArena::Node> nodes;
+            uint32_t rootFirstChild;
+            Subtree* parent;
+            uint32_t parentSlot, offset;
+        };
+
+        ImageContext& ctx;
         int mode, minBlock;
         double threshold, targetPercentage;
-        string inputPath, inputExtension, outputPath, gifPath;
+        string inputPath, inputExtension, outputPath, outputExtension, gifPath;
 
         bool lastImg;
-        QuadTreeNode root;
-        GifWriter g;
-        uint8_t* data;
-
-        time_t startTime, endTime;
+        QuadTreeArena::Node root;
+        QuadTreeArena tree;
+        vector<uint32_t> leaves;
+        GifEncoder gif;
+        int frameTop, frameLeft, frameBottom, frameRight;
+        vector<uint32_t> frameColors;
+
+        int threads;
+        long long tileArea;
+        bool estimateSize, confirmSize, levelLayout;
+        chrono::steady_clock::time_point startTime, outputTime, endTime, measuredTime;
 
         int initialSize;
         int finalSize;
@@ -65,71 +84,66 @@ class QuadTree {
 
         int quadtreeDepth;
         int quadtreeNode;
+        string errorMessage;
+
+        /**
+         * @brief Paint a node of the tree and record it in the region of the next GIF frame
+         * @param index Index of the node
+         * @param image Pointer to the image data
+         */
+        void paintFrameNode(uint32_t index, unsigned char* image) {
+            const QuadTreeArena::Node& node = tree[index];
+            tree.paint(index, image, ctx.imgWidth, ctx.imgChannels);
+
+            frameTop = min(frameTop, node.x);
+            frameLeft = min(frameLeft, node.y);
+            frameBottom = max(frameBottom, node.x + node.height);
+            frameRight = max(frameRight, node.y + node.width);
+            frameColors.push_back((uint32_t)node.color[0] << 16 | (uint32_t)node.color[1] << 8 | node.color[2]);
+        }
+
+        /**
+         * @brief Write the region painted since the last frame of an image to GIF animation
+         * @param image Pointer to the image data
+         */
+        void writeFrameToGif(const unsigned char* image) {
+            gif.write(image, ctx.imgChannels, 100, frameLeft, frameTop, frameRight - frameLeft, frameBottom - frameTop, move(frameColors));
+
+            frameTop = frameLeft = INT_MAX;
+            frameBottom = frameRight = 0;
+            frameColors.clear();
+        }
 
         /**
          * @brief Write current image data to GIF animation
          */
         void writeCurrImageToGif() {
-            for (int i = 0; i < imgWidth; i++) {
-                for (int j = 0; j < imgHeight; j++) {
-                    int idx = (j * imgWidth + i) * imgChannels;
-                    int outIdx = (j * imgWidth + i) * 4;
-
-                    data[outIdx + 0] = currImgData[idx + 0];
-                    data[outIdx + 1] = currImgData[idx + 1];
-                    data[outIdx + 2] = currImgData[idx + 2];
-                    
-                    if (imgChannels == 4) {
-                        data[outIdx + 3] = currImgData[idx + 3];
-                    } 
-                    else {
-                        data[outIdx + 3] = 255;
-                    }
-                }
-            }
-
-            GifWriteFrame(&g, data, imgWidth, imgHeight, 100);
+            writeFrameToGif(ctx.currImgData);
         }
 
         /**
          * @brief Write temporary image data to GIF animation
          */
         void writeTempImageToGif() {
-            for (int i = 0; i < imgWidth; i++) {
-                for (int j = 0; j < imgHeight; j++) {
-                    int idx = (j * imgWidth + i) * imgChannels;
-                    int outIdx = (j * imgWidth + i) * 4;
-
-                    data[outIdx + 0] = tempImgData[idx + 0];
-                    data[outIdx + 1] = tempImgData[idx + 1];
-                    data[outIdx + 2] = tempImgData[idx + 2];
-
-                    if (imgChannels == 4) {
-                        data[outIdx + 3] = currImgData[idx + 3];
-                    } 
-                    else {
-                        data[outIdx + 3] = 255;
-                    }
-                }
-            }
-
-            GifWriteFrame(&g, data, imgWidth, imgHeight, 100);
+            writeFrameToGif(ctx.tempImgData);
         }
 
         /**
          * @brief Write current image data to file
          * @param path Output file path
+         * @return True if the image was written, or if there is no path
          */
-        void writeCurrImage(string path) const {
+        bool writeCurrImage(string path) const {
 
             if (!path.empty()) {
                 if (inputExtension == "png") {
-                    stbi_write_png(path.c_str(), imgWidth, imgHeight, imgChannels, currImgData, imgWidth * imgChannels);
+                    return stbi_write_png(path.c_str(), ctx.imgWidth, ctx.imgHeight, ctx.imgChannels, ctx.currImgData, ctx.imgWidth * ctx.imgChannels) != 0;
                 } 
                 else {
-                    stbi_write_jpg(path.c_str(), imgWidth, imgHeight, imgChannels, currImgData, compressionQuality);
+                    return stbi_write_jpg(path.c_str(), ctx.imgWidth, ctx.imgHeight, ctx.imgChannels, ctx.currImgData, ctx.compressionQuality) != 0;
                 }
             }
+            return true;
         }
     
         /**
@@ -140,18 +154,584 @@ class QuadTree {
 
             if (!path.empty()) {
                 if (inputExtension == "png") {
-                    stbi_write_png(path.c_str(), imgWidth, imgHeight, 4, tempImgData, imgWidth * imgChannels);
+                    stbi_write_png(path.c_str(), ctx.imgWidth, ctx.imgHeight, 4, ctx.tempImgData, ctx.imgWidth * ctx.imgChannels);
                 } 
                 else {
-                    stbi_write_jpg(path.c_str(), imgWidth, imgHeight, 3, tempImgData, compressionQuality);
+                    stbi_write_jpg(path.c_str(), ctx.imgWidth, ctx.imgHeight, 3, ctx.tempImgData, ctx.compressionQuality);
+                }
+            }
+        }
+
+        /**
+         * @brief Check whether a node is a leaf of the quadtree
+         * @param node Node to check
+         * @return True if the node is not split any further
+         */
+        bool isLeaf(const QuadTreeArena::Node& node) const {
+            return node.width == 0 || node.height == 0 || ((long long)node.width * (long long)node.height) < minBlock || node.error <= threshold;
+        }
+
+        /**
+         * @brief Build the error method of the image and measure the root, once before the first build
+         */
+        void prepare() {
+            if (ctx.errorMethod != nullptr) return;
+            if (ctx.stats != nullptr) ctx.stats -> setMode(mode);
+
+            {
+                CompressionStats::Timer timer(ctx.stats, CompressionStats::TABLE_BUILD);
+                ctx.errorMethod = ErrorMethod::create(mode, ctx);
+            }
+            {
+                CompressionStats::Timer timer(ctx.stats, CompressionStats::ERROR_EVALUATION);
+                root = QuadTreeArena::measure(ctx, 0, 0, 0, ctx.imgWidth, ctx.imgHeight);
+            }
+
+            if (ctx.stats != nullptr) {
+                long long scanned = ctx.errorMethod -> getScannedPixels(0, 0, ctx.imgWidth, ctx.imgHeight);
+                ctx.stats -> addRegions(1, scanned, (long long)ctx.imgWidth * ctx.imgHeight - scanned);
+            }
+        }
+
+        /**
+         * @brief Build the quadtree level by level on one thread, writing a GIF frame for every level
+         *        The tree itself is the level-order queue, without GIF frames the leaves are painted once the tree is complete
+         * @param writeGif Whether GIF frames are written
+         */
+        void buildSerial(bool writeGif) {
+            tree.clear();
+            tree.add(root);
+            int curMaxStep = 0;
+            long long leafCount = 0;
+            if (writeGif) {
+                memcpy(ctx.tempImgData, ctx.currImgData, ctx.imgWidth * ctx.imgHeight * ctx.imgChannels);
+                frameTop = frameLeft = INT_MAX;
+                frameBottom = frameRight = 0;
+                frameColors.clear();
+            }
+
+            for (uint32_t i = 0; i < tree.size(); i++) {
+                QuadTreeArena::Node node = tree[i];
+                
+                if (lastImg) quadtreeNode++;
+
+                int step = node.step;
+                if (step > curMaxStep && lastImg) {
+                    quadtreeDepth = step;
+                    curMaxStep = step;
+                    if (writeGif) {
+                        writeTempImageToGif();
+                        memcpy(ctx.tempImgData, ctx.currImgData, node.width * node.height * ctx.imgChannels);
+                    }
+                }
+
+                if (isLeaf(node)) {
+                    leafCount++;
+                    if (writeGif) {
+                        tree.paint(i, ctx.currImgData, ctx.imgWidth, ctx.imgChannels);
+                        paintFrameNode(i, ctx.tempImgData);
+                    }
+                    continue;
+                } 
+                else {
+                    if (writeGif) {
+                        paintFrameNode(i, ctx.tempImgData);
+                    }
+
+                    QuadTreeArena::Node children[4];
+                    QuadTreeArena::split(ctx, node, children);
+                    tree.addChildren(i, children);
+                }
+            }
+
+            if (ctx.stats != nullptr) ctx.stats -> addNodes(tree.size(), leafCount);
+            if (!writeGif) paintTreeLeaves();
+        }
+
+        /**
+         * @brief Build a subtree depth-first into its own node list, handing children of at least PARALLEL_MIN_AREA pixels to the pool
+         *        The root of the subtree lives in the list of its parent, so a subtree only records where its root's children start
+         * @param pool Thread pool running the build
+         * @param subtree Subtree to build
+         * @param start Root node of the subtree
+         * @param nodeCount Shared node counter
+         * @param maxDepth Shared maximum depth
+         * @param subtrees Every subtree of the build, in the order they were created
+         * @param subtreeLock Lock of the subtree list
+         */
+        void buildSubtree(ThreadPool& pool, Subtree* subtree, QuadTreeArena::Node start, atomic<int>& nodeCount, atomic<int>& maxDepth, vector<unique_ptr<Subtree>>& subtrees, mutex& subtreeLock) {
+            const uint32_t ROOT = QuadTreeArena::NO_CHILD;
+            vector<QuadTreeArena::Node>& nodes = subtree -> nodes;
+            vector<uint32_t> stack;
+            stack.push_back(ROOT);
+            int localCount = 0, localDepth = 0, localLeaves = 0;
+
+            while (!stack.empty()) {
+                uint32_t index = stack.back();
+                stack.pop_back();
+                QuadTreeArena::Node node = index == ROOT ? start : nodes[index];
+
+                localCount++;
+                localDepth = max(localDepth, (int)node.step);
+
+                if (isLeaf(node)) {
+                    localLeaves++;
+                    continue;
+                }
+
+                QuadTreeArena::Node children[4];
+                QuadTreeArena::split(ctx, node, children);
+                uint32_t first = nodes.size();
+                nodes.insert(nodes.end(), children, children + 4);
+                if (index == ROOT) subtree -> rootFirstChild = first;
+                else nodes[index].firstChild = first;
+
+                for (uint32_t k = 0; k < 4; k++) {
+                    const QuadTreeArena::Node& child = children[k];
+                    if ((long long)child.width * child.height < PARALLEL_MIN_AREA) {
+                        stack.push_back(first + k);
+                        continue;
+                    }
+
+                    Subtree* next = new Subtree{{}, QuadTreeArena::NO_CHILD, subtree, first + k, 0};
+                    {
+                        lock_guard<mutex> lock(subtreeLock);
+                        subtrees.emplace_back(next);
+                    }
+                    pool.submit([this, &pool, next, child, &nodeCount, &maxDepth, &subtrees, &subtreeLock]() {
+                        buildSubtree(pool, next, child, nodeCount, maxDepth, subtrees, subtreeLock);
+                    });
+                }
+            }
+
+            nodeCount += localCount;
+            if (ctx.stats != nullptr) ctx.stats -> addNodes(localCount, localLeaves);
+            int depth = maxDepth;
+            while (localDepth > depth && !maxDepth.compare_exchange_weak(depth, localDepth)) {}
+        }
+
+        /**
+         * @brief Build the quadtree on a work-stealing thread pool, without GIF frames, then paint its leaves
+         *        The subtrees are appended to the tree one after another, shifting their child indices by where they land
+         */
+        void buildParallel() {
+            atomic<int> nodeCount(0), maxDepth(0);
+            vector<unique_ptr<Subtree>> subtrees;
+            mutex subtreeLock;
+            subtrees.emplace_back(new Subtree{{}, QuadTreeArena::NO_CHILD, nullptr, 0, 0});
+
+            {
+                ThreadPool pool(threads);
+                Subtree* top = subtrees[0].get();
+                pool.run([this, &pool, top, &nodeCount, &maxDepth, &subtrees, &subtreeLock]() {
+                    buildSubtree(pool, top, root, nodeCount, maxDepth, subtrees, subtreeLock);
+                });
+            }
+
+            tree.clear();
+            tree.add(root);
+            for (unique_ptr<Subtree>& subtree : subtrees) {
+                subtree -> offset = tree.size();
+                for (QuadTreeArena::Node node : subtree -> nodes) {
+                    if (node.firstChild != QuadTreeArena::NO_CHILD) node.firstChild += subtree -> offset;
+                    tree.add(node);
+                }
+                vector<QuadTreeArena::Node>().swap(subtree -> nodes);
+            }
+
+            for (unique_ptr<Subtree>& subtree : subtrees) {
+                uint32_t slot = subtree -> parent == nullptr ? 0 : subtree -> parent -> offset + subtree -> parentSlot;
+                if (subtree -> rootFirstChild != QuadTreeArena::NO_CHILD) tree[slot].firstChild = subtree -> offset + subtree -> rootFirstChild;
+            }
+
+            paintTreeLeaves();
+
+            if (lastImg) {
+                quadtreeNode += nodeCount;
+                quadtreeDepth = max(quadtreeDepth, (int)maxDepth);
+            }
+        }
+
+        /**
+         * @brief Compress tile by tile, the tiles being the first quadtree regions of at most tileArea pixels, so no block crosses a tile
+         *        The regions above the tiles are measured from the merged histograms of their tiles and cut exactly as a whole-image build would,
+         *        then every tile they reach is copied out and compressed by its own QuadTree, on one thread each, and copied back.
+         *        Only the tiles being compressed hold error tables and nodes, the tree keeps just the regions above the tiles
+         */
+        void buildTiled() {
+            const int BINS = HistogramTree::BINS;
+
+            // Regions larger than a tile are divided along the split geometry, the tree is their level-order queue
+            tree.clear();
+            tree.add({0, 0, ctx.imgWidth, ctx.imgHeight, 0, QuadTreeArena::NO_CHILD, {0, 0, 0}, 0});
+            vector<uint32_t> tiles;
+            for (uint32_t i = 0; i < tree.size(); i++) {
+                QuadTreeArena::Node node = tree[i];
+                if ((long long)node.width * node.height <= tileArea) {
+                    tiles.push_back(i);
+                    continue;
+                }
+
+                QuadTreeArena::Node children[4];
+                QuadTreeArena::divide(node, children);
+                tree.addChildren(i, children);
+            }
+
+            // Count the histogram of every tile, then merge them up, children always come after their parent
+            vector<unsigned long long> histograms((size_t)tree.size() * 3 * BINS, 0);
+            auto countTile = [this, &histograms](uint32_t index) {
+                const QuadTreeArena::Node& tile = tree[index];
+                unsigned long long* hist = &histograms[(size_t)index * 3 * BINS];
+                for (int i = tile.x; i < tile.x + tile.height; i++) {
+                    const unsigned char* pixel = ctx.currImgData + ((size_t)i * ctx.imgWidth + tile.y) * ctx.imgChannels;
+                    for (int j = 0; j < tile.width; j++, pixel += ctx.imgChannels) {
+                        hist[pixel[0]]++;
+                        hist[BINS + pixel[1]]++;
+                        hist[2 * BINS + pixel[2]]++;
+                    }
+                }
+            };
+
+            auto countStart = chrono::steady_clock::now();
+            {
+                ThreadPool pool(threads);
+                pool.run([&pool, &tiles, &countTile]() {
+                    for (uint32_t index : tiles) pool.submit([&countTile, index]() { countTile(index); });
+                });
+            }
+
+            for (uint32_t i = tree.size(); i-- > 0;) {
+                uint32_t first = tree[i].firstChild;
+                if (first == QuadTreeArena::NO_CHILD) continue;
+
+                unsigned long long* to = &histograms[(size_t)i * 3 * BINS];
+                for (uint32_t k = 0; k < 4; k++) {
+                    const unsigned long long* from = &histograms[(size_t)(first + k) * 3 * BINS];
+                    for (int b = 0; b < 3 * BINS; b++) to[b] += from[b];
+                }
+            }
+            if (ctx.stats != nullptr) ctx.stats -> addTime(CompressionStats::TABLE_BUILD, chrono::steady_clock::now() - countStart);
+
+            // Cut the regions above the tiles, a region within the threshold is painted whole and its tiles are never compressed
+            vector<uint32_t> reached;
+            vector<bool> visited(tree.size(), false);
+            visited[0] = true;
+            leaves.clear();
+            int topCount = 0, topDepth = 0;
+            long long measuredCount = 0, measuredArea = 0, emptyCount = 0;
+            auto cutStart = chrono::steady_clock::now();
+
+            for (uint32_t i = 0; i < tree.size(); i++) {
+                if (!visited[i]) continue;
+                QuadTreeArena::Node& node = tree[i];
+                long long area = (long long)node.width * node.height;
+
+                if (area <= tileArea) {
+                    if (area > 0) reached.push_back(i);
+                    else {
+                        emptyCount++;
+                        topCount++;
+                        topDepth = max(topDepth, (int)node.step);
+                    }
+                    continue;
+                }
+
+                topCount++;
+                topDepth = max(topDepth, (int)node.step);
+
+                double avg[3] = {0, 0, 0};
+                node.error = ErrorMethod::histogramError(mode, &histograms[(size_t)i * 3 * BINS], area, avg[0], avg[1], avg[2]);
+                measuredCount++;
+                measuredArea += area;
+                for (int c = 0; c < 3; c++) node.color[c] = static_cast<unsigned char>(avg[c]);
+
+                if (isLeaf(node)) {
+                    node.firstChild = QuadTreeArena::NO_CHILD;
+                    leaves.push_back(i);
+                    continue;
+                }
+
+                for (uint32_t k = 0; k < 4; k++) visited[node.firstChild + k] = true;
+            }
+            vector<unsigned long long>().swap(histograms);
+
+            // The regions above the tiles come from the histograms, the tiles count their own nodes
+            if (ctx.stats != nullptr) {
+                ctx.stats -> setMode(mode);
+                ctx.stats -> addTime(CompressionStats::ERROR_EVALUATION, chrono::steady_clock::now() - cutStart);
+                ctx.stats -> addNodes(topCount, leaves.size() + emptyCount);
+                ctx.stats -> addRegions(measuredCount, 0, measuredArea);
+            }
+
+            // Every reached tile is a region of its own image, built by a QuadTree as if it were the whole image
+            atomic<int> nodeCount(0), maxDepth(0);
+            atomic<bool> failed(false);
+            auto compressTile = [this, &nodeCount, &maxDepth, &failed](QuadTreeArena::Node tile) {
+                size_t rowBytes = (size_t)tile.width * ctx.imgChannels;
+                ImageContext tileCtx;
+                tileCtx.imgWidth = tile.width;
+                tileCtx.imgHeight = tile.height;
+                tileCtx.imgChannels = ctx.imgChannels;
+                tileCtx.lowMemory = ctx.lowMemory;
+                tileCtx.stats = ctx.stats;
+                tileCtx.currImgData = (unsigned char*) malloc(rowBytes * tile.height);
+                if (tileCtx.currImgData == nullptr) {
+                    failed = true;
+                    return;
+                }
+
+                unsigned char* origin = ctx.currImgData + ((size_t)tile.x * ctx.imgWidth + tile.y) * ctx.imgChannels;
+                size_t stride = (size_t)ctx.imgWidth * ctx.imgChannels;
+                for (int i = 0; i < tile.height; i++) memcpy(tileCtx.currImgData + i * rowBytes, origin + i * stride, rowBytes);
+
+                {
+                    QuadTree tileTree(tileCtx, "", mode, threshold, minBlock, 0, "", "", inputExtension);
+                    tileTree.buildQuadTree();
+
+                    nodeCount += tileTree.getQuadtreeNode();
+                    int depth = maxDepth, tileDepth = tile.step + tileTree.getQuadtreeDepth();
+                    while (tileDepth > depth && !maxDepth.compare_exchange_weak(depth, tileDepth)) {}
+                }
+
+                for (int i = 0; i < tile.height; i++) memcpy(origin + i * stride, tileCtx.currImgData + i * rowBytes, rowBytes);
+            };
+
+            {
+                ThreadPool pool(threads);
+                pool.run([this, &pool, &reached, &compressTile]() {
+                    for (uint32_t index : reached) {
+                        QuadTreeArena::Node tile = tree[index];
+                        pool.submit([&compressTile, tile]() { compressTile(tile); });
+                    }
+                });
+            }
+            if (failed) {
+                errorMessage = "Gagal alokasi memori buat tile, coba ulang ya.";
+                return;
+            }
+
+            // The painted regions above the tiles do not overlap any reached tile
+            paintLeaves();
+            vector<uint32_t>().swap(leaves);
+            tree.release();
+
+            if (lastImg) {
+                quadtreeNode += topCount + nodeCount;
+                quadtreeDepth = max(quadtreeDepth, max(topDepth, (int)maxDepth));
+            }
+        }
+
+        /**
+         * @brief Paint every leaf of the tree
+         */
+        void paintTreeLeaves() {
+            leaves.clear();
+            for (uint32_t i = 0; i < tree.size(); i++) {
+                if (tree.isLeaf(i) && tree[i].width > 0 && tree[i].height > 0) leaves.push_back(i);
+            }
+
+            paintLeaves();
+            vector<uint32_t>().swap(leaves);
+        }
+
+        /**
+         * @brief Paint the collected leaves into the current image in one pass over horizontal stripes of STRIPE_ROWS rows
+         *        Each stripe only paints the rows of its leaves inside it, so the stripes are painted in parallel without locking
+         */
+        void paintLeaves() {
+            int stripes = (ctx.imgHeight + STRIPE_ROWS - 1) / STRIPE_ROWS;
+            if (stripes == 0) return;
+            CompressionStats::Timer timer(ctx.stats, CompressionStats::LEAF_FILL);
+
+            // Bucket the leaves by the stripes they cross, counting first so the buckets share one array
+            vector<int> start(stripes + 1, 0);
+            for (uint32_t index : leaves) {
+                const QuadTreeArena::Node& leaf = tree[index];
+                for (int s = leaf.x / STRIPE_ROWS; s <= (leaf.x + leaf.height - 1) / STRIPE_ROWS; s++) start[s + 1]++;
+            }
+            for (int s = 0; s < stripes; s++) start[s + 1] += start[s];
+
+            vector<uint32_t> order(start[stripes]);
+            vector<int> next(start.begin(), start.end() - 1);
+            for (uint32_t index : leaves) {
+                const QuadTreeArena::Node& leaf = tree[index];
+                for (int s = leaf.x / STRIPE_ROWS; s <= (leaf.x + leaf.height - 1) / STRIPE_ROWS; s++) order[next[s]++] = index;
+            }
+
+            auto paintStripe = [this, &start, &order](int s) {
+                int top = s * STRIPE_ROWS, bottom = min(top + STRIPE_ROWS, ctx.imgHeight);
+                for (int k = start[s]; k < start[s + 1]; k++) {
+                    const QuadTreeArena::Node& leaf = tree[order[k]];
+                    int from = max(leaf.x, top), to = min(leaf.x + leaf.height, bottom);
+                    QuadTreeNode::fillRectangle(ctx.currImgData, ctx.imgWidth, ctx.imgChannels, from, leaf.y, leaf.width, to - from, leaf.color);
+                }
+            };
+
+            if (threads <= 1 || stripes == 1) {
+                for (int s = 0; s < stripes; s++) paintStripe(s);
+                return;
+            }
+
+            ThreadPool pool(threads);
+            pool.run([&pool, stripes, &paintStripe]() {
+                for (int s = 0; s < stripes; s++) pool.submit([&paintStripe, s]() { paintStripe(s); });
+            });
+        }
+
+        /**
+         * @brief Write the output and the compression statistics of the final image
+         * @param writeGif Whether the GIF visualization is finished too
+         */
+        void finishCompression(bool writeGif) {
+            outputTime = chrono::steady_clock::now();
+            if (writeGif) writeCurrImageToGif();
+
+            // A .qtz output is the tree itself, so its size is known once it is encoded
+            vector<uint8_t> encodedTree;
+            {
+                CompressionStats::Timer timer(ctx.stats, CompressionStats::OUTPUT_ENCODE);
+                if (outputExtension == "qtz") {
+                    encodedTree = QuadTreeCodec::encode(tree, ctx.currImgData, ctx.imgWidth, ctx.imgHeight, ctx.imgChannels, levelLayout);
+                    if (!QuadTreeCodec::write(outputPath, encodedTree)) errorMessage = "Output .qtz-nya gagal ditulis.";
                 }
+                else if (!writeCurrImage(outputPath)) errorMessage = "Output-nya gagal ditulis.";
+            }
+
+            // Wait for the frames still being encoded, so the time covers the whole GIF
+            if (writeGif) gif.end();
+            
+            endTime = chrono::steady_clock::now();
+            if (outputExtension == "qtz") finalSize = encodedTree.size();
+            else finalSize = probeEncodedSize();
+            if (initialSize > 0) {
+                compressionPercentage = ((double)(initialSize - finalSize) / initialSize) * 100.0;
             }
+            measuredTime = chrono::steady_clock::now();
+        }
+
+        /**
+         * @brief Build every node down to the minimum block size, ignoring the threshold, since no node error depends on it
+         *        The tree itself is the level-order queue, so the children of a node are always four consecutive entries
+         */
+        void buildErrorTree() {
+            tree.clear();
+            tree.add(root);
+
+            long long leafCount = 0;
+            for (uint32_t i = 0; i < tree.size(); i++) {
+                QuadTreeArena::Node node = tree[i];
+                if (node.width == 0 || node.height == 0 || ((long long)node.width * (long long)node.height) < minBlock) {
+                    leafCount++;
+                    continue;
+                }
+
+                QuadTreeArena::Node children[4];
+                QuadTreeArena::split(ctx, node, children);
+                tree.addChildren(i, children);
+            }
+
+            if (ctx.stats != nullptr) ctx.stats -> addNodes(tree.size(), leafCount);
+        }
+
+        /**
+         * @brief Compress with the current threshold by cutting the error tree, without measuring any node again
+         *        Visits exactly the nodes the level-order build would, so the image and statistics are the same
+         * @param paint Whether the leaves are painted, false to only measure the cut
+         * @return Sum of width + height over the leaves, the block edges that cost bytes in the encoded image
+         */
+        long long cutErrorTree(bool paint = true) {
+            vector<uint32_t> stack;
+            stack.push_back(0);
+            long long leafEdges = 0, visitedCount = 0, leafCount = 0;
+            leaves.clear();
+
+            while (!stack.empty()) {
+                uint32_t i = stack.back();
+                stack.pop_back();
+                const QuadTreeArena::Node& node = tree[i];
+                visitedCount++;
+
+                if (lastImg) {
+                    quadtreeNode++;
+                    quadtreeDepth = max(quadtreeDepth, (int)node.step);
+                }
+
+                if (node.firstChild == QuadTreeArena::NO_CHILD || node.error <= threshold) {
+                    leafCount++;
+                    if (node.width > 0 && node.height > 0) {
+                        leafEdges += node.width + node.height;
+                        if (paint) leaves.push_back(i);
+                    }
+                    continue;
+                }
+
+                for (uint32_t k = 0; k < 4; k++) stack.push_back(node.firstChild + k);
+            }
+
+            if (ctx.stats != nullptr) ctx.stats -> addNodes(visitedCount, leafCount);
+            if (paint) paintLeaves();
+            return leafEdges;
+        }
+
+        /**
+         * @brief Encode the current image in memory to measure its size, timed as a size probe
+         * @return Encoded size in bytes
+         */
+        size_t probeEncodedSize() const {
+            CompressionStats::Timer timer(ctx.stats, CompressionStats::SIZE_PROBE);
+            return Image::getEncodedSize(ctx.currImgData, ctx.imgWidth, ctx.imgHeight, inputExtension, ctx.imgChannels, ctx.compressionQuality);
+        }
+
+        /**
+         * @brief Get the encoded size of the image cut at the current threshold
+         * @param estimator Size model, predicts once calibrated and learns from every real encode, nullptr to always encode
+         * @return Encoded size in bytes, real or predicted
+         */
+        size_t measureCut(SizeEstimator* estimator) {
+            if (estimator != nullptr && estimator -> isCalibrated()) {
+                return estimator -> predict(cutErrorTree(false));
+            }
+
+            long long leafEdges = cutErrorTree();
+            size_t size = probeEncodedSize();
+            if (estimator != nullptr) estimator -> addSample(leafEdges, size);
+            return size;
+        }
+
+        /**
+         * @brief Binary search the smallest threshold whose image fits the target size
+         * @param l Lower bound of the threshold
+         * @param r Upper bound of the threshold
+         * @param targetImageSize Target encoded size in bytes
+         * @param estimator Size model, nullptr to encode every step
+         * @return Best threshold, -1 if no step fit the target, the last step is then left in threshold
+         */
+        double searchThreshold(double l, double r, size_t targetImageSize, SizeEstimator* estimator) {
+            double bestThreshold = -1;
+
+            for (int i = 1; i <= 13; i++) {
+                double mid = (l + r) / 2;
+                threshold = mid;
+                size_t currentImageSize = measureCut(estimator);
+
+                if (currentImageSize <= targetImageSize) {
+                    bestThreshold = mid;
+                    r = mid;
+                } 
+                else l = mid;
+            }
+
+            return bestThreshold;
         }
   
     public:
+        static constexpr long long PARALLEL_MIN_AREA = 64 * 64;
+        static constexpr int STRIPE_ROWS = 64;
+        static constexpr int MIN_TILE_SIZE = 64;
 
         /**
          * @brief Constructor that initializes compression parameters
+         * @param ctx Image context with the loaded image
          * @param inputPath Path to input image
          * @param mode Error calculation mode
          * @param threshold Error threshold
@@ -161,7 +741,7 @@ class QuadTree {
          * @param gifPath Path for output GIF
          * @param inputExtension Input image format
          */
-        QuadTree(string inputPath, int mode, double threshold, int minBlock, double targetPercentage, string outputPath, string gifPath, string inputExtension) {
+        QuadTree(ImageContext& ctx, string inputPath, int mode, double threshold, int minBlock, double targetPercentage, string outputPath, string gifPath, string inputExtension) : ctx(ctx) {
             
             this -> inputPath = inputPath;
             this -> mode = mode;
@@ -169,20 +749,34 @@ class QuadTree {
             this -> minBlock = minBlock;
             this -> targetPercentage = targetPercentage;
             this -> outputPath = outputPath;
+            this -> outputExtension = outputPath.substr(outputPath.find_last_of('.') + 1);
             this -> gifPath = gifPath;
             this -> inputExtension = inputExtension;
-            this -> root = QuadTreeNode(0, 0, 0, imgWidth, imgHeight, mode);
             
             if (targetPercentage == 0) lastImg = true;
             else lastImg = false;
 
-            char* gifPathCopy = new char[gifPath.length() + 1];
-            strcpy(gifPathCopy, gifPath.c_str());
-            GifBegin(&g, gifPathCopy, imgWidth, imgHeight, 50);
-
-            this -> data = (uint8_t*) malloc (imgWidth * imgHeight * 4);
-            this -> initialSize = Image::getOriginalSize(inputPath);
-            this -> startTime = clock();
+            // GIF visualization is optional, its writer and frame buffer are only set up when a path is given
+            if (!gifPath.empty() && gif.begin(gifPath, ctx.imgWidth, ctx.imgHeight, 50)) {
+                if (ctx.tempImgData == nullptr) ctx.tempImgData = (unsigned char*) malloc((size_t)ctx.imgWidth * ctx.imgHeight * ctx.imgChannels);
+                if (ctx.tempImgData == nullptr) gif.end();
+            }
+            gif.setStats(ctx.stats);
+
+            // In-memory images have no input file, their initial size is set by the caller
+            this -> initialSize = inputPath.empty() ? 0 : Image::getOriginalSize(inputPath);
+            this -> finalSize = 0;
+            this -> compressionPercentage = 0;
+            this -> threads = 1;
+            this -> tileArea = 0;
+            this -> estimateSize = false;
+            this -> confirmSize = false;
+            this -> levelLayout = false;
+            this -> startTime = chrono::steady_clock::now();
+            this -> outputTime = this -> startTime;
+            this -> endTime = this -> startTime;
+            this -> measuredTime = this -> startTime;
+            this -> quadtreeDepth = 0;
             this -> quadtreeNode = 0;
         }
     
@@ -190,9 +784,10 @@ class QuadTree {
          * @brief Destructor that cleans up resources
          */
         ~QuadTree() {
-            if (data != nullptr) {
-                free(data);
-                data = nullptr;
+            // Release the error method built for this image
+            if (ctx.errorMethod != nullptr) {
+                delete ctx.errorMethod;
+                ctx.errorMethod = nullptr;
             }
         }
 
@@ -200,60 +795,32 @@ class QuadTree {
          * @brief Perform quadtree compression with fixed threshold
          */
         void performQuadTree() {
-            queue<QuadTreeNode> q;
-            q.push(root);
-            int curMaxStep = 0;
-            memcpy(tempImgData, currImgData, imgWidth * imgHeight * imgChannels);
+            bool writeGif = lastImg && gif.isOpen();
 
-            while (!q.empty()) {
-                QuadTreeNode node = q.front();
-                q.pop();
-                
-                if (lastImg) quadtreeNode++;
+            // An image larger than a tile never builds the tables of the whole image, GIF frames need them
+            if (tileArea > 0 && (long long)ctx.imgWidth * ctx.imgHeight > tileArea && !writeGif) {
+                buildTiled();
+                if (lastImg && errorMessage.empty()) finishCompression(false);
+                return;
+            }
 
-                int step = node.getStep();
-                int X = node.getX();
-                int Y = node.getY();
-                int width = node.getWidth();
-                int height = node.getHeight();
-                if (step < curMaxStep) continue;
+            prepare();
 
-                if (step > curMaxStep && lastImg) {
-                    quadtreeDepth = step;
-                    curMaxStep = step;
-                    writeTempImageToGif();
-                    memcpy(tempImgData, currImgData, width * height * imgChannels);
-                }
-
-                if (width == 0 || height == 0 || ((long long)node.getWidth() * (long long)node.getHeight()) < minBlock || node.getError() <= threshold) {
-                    node.fillCurrRectangle();
-                    if (lastImg) {
-                        node.fillTempRectangle();
-                    }
-                    continue;
-                } 
-                else {
-                    if (lastImg) {
-                        node.fillTempRectangle();
-                    }
-                    q.push(QuadTreeNode(step + 1, X, Y, width / 2, height / 2, mode));
-                    q.push(QuadTreeNode(step + 1, X + height / 2, Y, width / 2, height - height / 2, mode));
-                    q.push(QuadTreeNode(step + 1, X, Y + width / 2, width - width / 2, height / 2, mode));
-                    q.push(QuadTreeNode(step + 1, X + height / 2, Y + width / 2, width - width / 2, height - height / 2 , mode));
-                }
-            }
+            // GIF frames follow the tree level by level, which only the serial build does
+            if (threads > 1 && !writeGif) buildParallel();
+            else buildSerial(writeGif);
 
-            if (lastImg) {
-                writeCurrImageToGif();
-                writeCurrImage(outputPath);
-                
-                endTime = clock();  
-                finalSize = Image::getEncodedSize(currImgData, imgWidth, imgHeight, inputExtension, imgChannels, compressionQuality);
-                compressionPercentage = ((double)(initialSize - finalSize) / initialSize) * 100.0;
+            if (lastImg) finishCompression(writeGif);
+        }
 
-                GifEnd(&g);
-                free(data);
-            }
+        /**
+         * @brief Build the quadtree at the fixed threshold and paint its leaves, without writing any output or measuring its size
+         *        Used for the tiles of a tiled compression, whose images are stitched by the caller
+         */
+        void buildQuadTree() {
+            prepare();
+            if (threads > 1) buildParallel();
+            else buildSerial(false);
         }
 
         /**
@@ -261,67 +828,64 @@ class QuadTree {
          * @param ratio Target compression ratio
          */
         void performBinserQuadTree(double ratio) {
-            ErrorMethod* errorMethod = nullptr;
             double lowerThreshold = 0.0, upperThreshold = 0.0;
-            
-            switch(mode) {
-                case 1:
-                    errorMethod = new Variance();
-                    break;
-                case 2:
-                    errorMethod = new MeanAbsoluteDeviation();
-                    break;
-                case 3:
-                    errorMethod = new MaxPixelDifference();
-                    break;
-                case 4:
-                    errorMethod = new Entropy();
-                    break;
-                case 5:
-                    errorMethod = new SSIM();
-                    break;
-                default:
-                    errorMethod = new Variance();
-                    break;
-            }
-            
-            if (errorMethod) 
-            {
-                lowerThreshold = errorMethod->getLowerThreshold();
-                upperThreshold = errorMethod->getUpperThreshold();
-                delete errorMethod;
-            }
+            ErrorMethod::getThresholdRange(mode, lowerThreshold, upperThreshold);
             
             double l = lowerThreshold, r = upperThreshold;
-            size_t initImageSize = Image::getOriginalSize(inputPath);
+            size_t initImageSize = initialSize;
             size_t targetImageSize = initImageSize - (initImageSize * ratio);
 
-            double bestThreshold = -1;
             lastImg = false;
+            prepare();
 
-            for (int i = 1; i <= 13; i++) {
-                double mid = (l + r) / 2;
-                threshold = mid;
-                performQuadTree();
-    
-                size_t currentImageSize = Image::getEncodedSize(currImgData, imgWidth, imgHeight, inputExtension, imgChannels, compressionQuality);
-
-                if (currentImageSize <= targetImageSize) {
-                    bestThreshold = mid;
-                    r = mid;
-                } 
-                else l = mid;
-
-                memcpy(currImgData, initImgData, imgWidth * imgHeight * imgChannels);
-            }
+            // Every binary search step is a cut through the same error tree
+            buildErrorTree();
 
+            SizeEstimator estimator;
+            SizeEstimator* sizeModel = estimateSize ? &estimator : nullptr;
+            double bestThreshold = searchThreshold(l, r, targetImageSize, sizeModel);
             if (bestThreshold == -1) {
                 bestThreshold = threshold;
             }
 
+            // A predicted candidate that is too big after all becomes a new sample, and the search goes on above it
+            for (int round = 0; estimateSize && confirmSize && round < SizeEstimator::CONFIRM_ROUNDS; round++) {
+                threshold = bestThreshold;
+                long long leafEdges = cutErrorTree();
+                size_t currentImageSize = probeEncodedSize();
+                if (currentImageSize <= targetImageSize) break;
+
+                estimator.addSample(leafEdges, currentImageSize);
+                double candidate = searchThreshold(bestThreshold, upperThreshold, targetImageSize, sizeModel);
+                bestThreshold = candidate == -1 ? threshold : candidate;
+            }
+
             lastImg = true;
             threshold = bestThreshold;
-            performQuadTree();
+
+            // The GIF needs a frame per level, so it is built again from the original image
+            bool writeGif = gif.isOpen();
+            if (writeGif) {
+                memcpy(ctx.currImgData, ctx.initImgData, ctx.imgWidth * ctx.imgHeight * ctx.imgChannels);
+                performQuadTree();
+            }
+            else {
+                cutErrorTree();
+
+                // Keep only the nodes of the final cut, which a .qtz output stores
+                tree.cut(threshold);
+                finishCompression(false);
+            }
+
+            vector<uint32_t>().swap(leaves);
+        }
+
+        /**
+         * @brief Get the quadtree of the last compression, its leaves are the painted blocks, empty after a tiled compression
+         * @return Tree of packed nodes, the root first
+         */
+        const QuadTreeArena& getTree() const {
+            return tree;
         }
 
         /**
@@ -353,7 +917,75 @@ class QuadTree {
          * @return Execution time
          */
         int getExecutionTime() const {
-            return (endTime - startTime) / (CLOCKS_PER_SEC / 1000);
+            return chrono::duration_cast<chrono::milliseconds>(endTime - startTime).count();
+        }
+
+        /**
+         * @brief Get the wall-clock time until the quadtree was complete, the error tables, the threshold search, and the painting
+         * @return Build time in milliseconds
+         */
+        double getBuildTime() const {
+            return chrono::duration<double, milli>(outputTime - startTime).count();
+        }
+
+        /**
+         * @brief Get the wall-clock time of writing the output, finishing the GIF, and measuring the final size
+         * @return Output time in milliseconds
+         */
+        double getOutputTime() const {
+            return chrono::duration<double, milli>(measuredTime - outputTime).count();
+        }
+
+        /**
+         * @brief Set the number of threads building the quadtree and encoding GIF frames, the result is the same for any count
+         * @param threads Thread count, 1 for the serial build
+         */
+        void setThreads(int threads) {
+            this -> threads = max(1, threads);
+            gif.setThreads(this -> threads);
+        }
+
+        /**
+         * @brief Compress the image tile by tile, each tile built with its own error tables, the result is the same as without tiles
+         *        Ignored by the target search and by a GIF visualization, which need the whole image
+         * @param tileSize Side of a square tile in pixels, the tiles are the quadtree regions of at most tileSize^2 pixels, 0 for no tiles
+         */
+        void setTileSize(int tileSize) {
+            this -> tileArea = tileSize > 0 ? (long long)max(tileSize, MIN_TILE_SIZE) * max(tileSize, MIN_TILE_SIZE) : 0;
+        }
+
+        /**
+         * @brief Choose how the target search measures the encoded size of each step
+         * @param estimateSize Predict the size from the leaf edges after a few calibrating encodes
+         * @param confirmSize Encode the predicted threshold, searching further while it misses the target
+         */
+        void setSizeEstimation(bool estimateSize, bool confirmSize) {
+            this -> estimateSize = estimateSize;
+            this -> confirmSize = confirmSize;
+        }
+
+        /**
+         * @brief Choose the layout of a .qtz output
+         * @param levelLayout Lay the tree out level by level, so that a prefix of the file decodes to a preview
+         */
+        void setLevelLayout(bool levelLayout) {
+            this -> levelLayout = levelLayout;
+        }
+
+        /**
+         * @brief Set the initial image size, for images that were not loaded from a file
+         * @param initialSize Initial size in bytes
+         */
+        void setInitialSize(int initialSize) {
+            this -> initialSize = initialSize;
+        }
+
+        /**
+         * @brief Get the error that stopped the compression, its image and statistics are then incomplete
+         * @return Error message, empty if the compression succeeded
+         */
+        const string& getErrorMessage() const {
+            return errorMessage;
         }
 
         /**
@@ -0,0 +1,222 @@
+#ifndef QUADTREEARENA_HPP
+#define QUADTREEARENA_HPP
+
+// Libraries
+#include <stdint.h>
+#include "QuadTreeNode.hpp"
+
+/**
+ * @brief Quadtree kept as one array of packed nodes, the four children of a node stored next to each other
+ *        A node refers to its first child by a 32-bit index, and keeps its painted color as bytes instead of the average doubles,
+ *        so the whole tree stays in memory after compression for queries and re-encoding
+ * @param NO_CHILD First child index of a leaf
+ * @param nodes Nodes of the tree, the root first
+ */
+class QuadTreeArena {
+
+    public:
+        static constexpr uint32_t NO_CHILD = UINT32_MAX;
+
+        struct Node {
+            int x, y, width, height;
+            double error;
+            uint32_t firstChild;
+            unsigned char color[3];
+            unsigned char step;
+        };
+
+    private:
+        vector<Node> nodes;
+
+    public:
+        /**
+         * @brief Measure a region with the error method of an image context
+         * @param ctx Image context whose error method measures the region
+         * @param step Depth of the node in the quadtree
+         * @param x Starting row
+         * @param y Starting column
+         * @param width Width of the region
+         * @param height Height of the region
+         * @return Leaf node of the region, black if the region is empty
+         */
+        static Node measure(ImageContext& ctx, int step, int x, int y, int width, int height) {
+            QuadTreeNode measured(ctx, step, x, y, width, height, 0);
+            Node node = {x, y, width, height, measured.getError(), NO_CHILD, {0, 0, 0}, (unsigned char)step};
+            if (width > 0 && height > 0) measured.getColor(node.color);
+            return node;
+        }
+
+        /**
+         * @brief Divide a node into the regions of its four children, in the split order of the quadtree, without measuring them
+         * @param node Node to divide
+         * @param children Output children, unmeasured leaves one level deeper
+         */
+        static void divide(const Node& node, Node children[4]) {
+            int x = node.x, y = node.y, width = node.width, height = node.height;
+            unsigned char step = node.step + 1;
+            children[0] = {x, y, width / 2, height / 2, 0, NO_CHILD, {0, 0, 0}, step};
+            children[1] = {x + height / 2, y, width / 2, height - height / 2, 0, NO_CHILD, {0, 0, 0}, step};
+            children[2] = {x, y + width / 2, width - width / 2, height / 2, 0, NO_CHILD, {0, 0, 0}, step};
+            children[3] = {x + height / 2, y + width / 2, width - width / 2, height - height / 2, 0, NO_CHILD, {0, 0, 0}, step};
+        }
+
+        /**
+         * @brief Measure the four children of a node, in the split order of the quadtree
+         *        With stats, the measuring is timed and the pixels the error method scans are counted, once for all four children
+         * @param ctx Image context whose error method measures the regions
+         * @param node Node to split
+         * @param children Output children
+         */
+        static void split(ImageContext& ctx, const Node& node, Node children[4]) {
+            divide(node, children);
+            {
+                CompressionStats::Timer timer(ctx.stats, CompressionStats::ERROR_EVALUATION);
+                for (int k = 0; k < 4; k++) {
+                    const Node& child = children[k];
+                    children[k] = measure(ctx, child.step, child.x, child.y, child.width, child.height);
+                }
+            }
+
+            if (ctx.stats != nullptr) {
+                long long scanned = 0;
+                for (int k = 0; k < 4; k++) scanned += ctx.errorMethod -> getScannedPixels(children[k].x, children[k].y, children[k].width, children[k].height);
+                ctx.stats -> addRegions(4, scanned, (long long)node.width * node.height - scanned);
+            }
+        }
+
+        /**
+         * @brief Append a node
+         * @param node Node to append
+         * @return Index of the node
+         */
+        uint32_t add(const Node& node) {
+            nodes.push_back(node);
+            return nodes.size() - 1;
+        }
+
+        /**
+         * @brief Append the four children of a node and link them to it
+         * @param parent Index of the node
+         * @param children Children of the node
+         * @return Index of the first child
+         */
+        uint32_t addChildren(uint32_t parent, const Node children[4]) {
+            uint32_t first = nodes.size();
+            nodes.insert(nodes.end(), children, children + 4);
+            nodes[parent].firstChild = first;
+            return first;
+        }
+
+        /**
+         * @brief Get a node
+         * @param index Index of the node
+         * @return Node
+         */
+        Node& operator[](uint32_t index) { return nodes[index]; }
+
+        /**
+         * @brief Get a node
+         * @param index Index of the node
+         * @return Node
+         */
+        const Node& operator[](uint32_t index) const { return nodes[index]; }
+
+        /**
+         * @brief Get the number of nodes
+         * @return Node count
+         */
+        uint32_t size() const { return nodes.size(); }
+
+        /**
+         * @brief Check whether the tree has no nodes
+         * @return True if there is no root
+         */
+        bool empty() const { return nodes.empty(); }
+
+        /**
+         * @brief Reserve room for nodes
+         * @param count Number of nodes
+         */
+        void reserve(size_t count) { nodes.reserve(count); }
+
+        /**
+         * @brief Remove every node, keeping the memory for the next tree
+         */
+        void clear() { nodes.clear(); }
+
+        /**
+         * @brief Remove every node and free the memory
+         */
+        void release() { vector<Node>().swap(nodes); }
+
+        /**
+         * @brief Check whether a node is a leaf
+         * @param index Index of the node
+         * @return True if the node has no children
+         */
+        bool isLeaf(uint32_t index) const { return nodes[index].firstChild == NO_CHILD; }
+
+        /**
+         * @brief Find the leaf covering a pixel
+         * @param row Row of the pixel
+         * @param col Column of the pixel
+         * @return Index of the leaf, NO_CHILD if the pixel is outside the tree
+         */
+        uint32_t findLeaf(int row, int col) const {
+            if (nodes.empty()) return NO_CHILD;
+
+            const Node& root = nodes[0];
+            if (row < root.x || col < root.y || row >= root.x + root.height || col >= root.y + root.width) return NO_CHILD;
+
+            uint32_t index = 0;
+            while (nodes[index].firstChild != NO_CHILD) {
+                uint32_t next = NO_CHILD;
+                for (uint32_t k = 0; k < 4 && next == NO_CHILD; k++) {
+                    const Node& c = nodes[nodes[index].firstChild + k];
+                    if (row >= c.x && col >= c.y && row < c.x + c.height && col < c.y + c.width) next = nodes[index].firstChild + k;
+                }
+                if (next == NO_CHILD) return NO_CHILD;
+                index = next;
+            }
+
+            return index;
+        }
+
+        /**
+         * @brief Make every node within a threshold a leaf and drop the nodes below it, renumbering the rest in level order
+         * @param threshold Largest error of a leaf
+         */
+        void cut(double threshold) {
+            if (nodes.empty()) return;
+
+            vector<Node> kept;
+            kept.push_back(nodes[0]);
+
+            for (size_t i = 0; i < kept.size(); i++) {
+                uint32_t first = kept[i].firstChild;
+                if (first == NO_CHILD || kept[i].error <= threshold) {
+                    kept[i].firstChild = NO_CHILD;
+                    continue;
+                }
+
+                kept[i].firstChild = kept.size();
+                for (uint32_t k = 0; k < 4; k++) kept.push_back(nodes[first + k]);
+            }
+
+            nodes.swap(kept);
+        }
+
+        /**
+         * @brief Paint a node with its color
+         * @param index Index of the node
+         * @param image Pointer to the image data
+         * @param imgWidth Width of the image in pixels
+         * @param imgChannels Number of color channels of the image
+         */
+        void paint(uint32_t index, unsigned char* image, int imgWidth, int imgChannels) const {
+            const Node& node = nodes[index];
+            QuadTreeNode::fillRectangle(image, imgWidth, imgChannels, node.x, node.y, node.width, node.height, node.color);
+        }
+};
+
+#endif
@@ -0,0 +1,660 @@
+#ifndef QUADTREECODEC_HPP
+#define QUADTREECODEC_HPP
+
+// Libraries
+#include <cstdio>
+#include <climits>
+#include "QuadTreeArena.hpp"
+
+/**
+ * @brief Native .qtz format that stores the quadtree itself instead of its painted pixels
+ *        Layout: the magic "QTZ" and VERSION, width and height as 32-bit little-endian, channels, the FLAG_ALPHA flags byte,
+ *        the byte length of the split flags, the split flags, then one range-coded stream of the leaf colors and the alpha plane
+ *        The split flags are one bit per node of a pre-order traversal, most significant bit first, set when the node is split,
+ *        nodes without pixels are skipped since they are never split or painted
+ *        Each leaf color is coded as its difference from the previous leaf of the traversal, green first, then red and blue
+ *        relative to the green difference, every difference byte through a binary tree of adaptive probabilities
+ *        The alpha plane is only stored when some pixel is not opaque, as a bit per pixel for a repeat of the left pixel
+ *        followed by the difference from it when it is not
+ *        With FLAG_LEVELS the tree is laid out breadth-first instead, the header field after the flags byte counting the levels:
+ *        every level is a 32-bit length and its own range-coded stream holding, for each node with pixels, its color as the
+ *        difference from its parent and then its split flag, and the alpha plane is one more such stream after the last level,
+ *        so any prefix of whole levels decodes to a coarser image of the same size
+ * @param VERSION Format version written after the magic
+ * @param HEADER_SIZE Size of the header in bytes, the split flags or the first level follow it
+ * @param FLAG_ALPHA Header flag for a stored alpha plane
+ * @param FLAG_LEVELS Header flag for the breadth-first layout
+ * @param LEVEL_CONTEXTS Levels with their own probabilities in the breadth-first layout, deeper levels share the last
+ * @param READ_BUFFER Bytes of the color stream read from the file at once while decoding
+ * @param PROB_BITS Precision of an adaptive probability
+ * @param MOVE_BITS Adaptation speed of a probability, the shift of each update
+ * @param TOP Smallest range kept by the range coder before a byte is shifted out
+ */
+class QuadTreeCodec {
+
+    public:
+        static constexpr uint8_t VERSION = 1;
+        static constexpr int HEADER_SIZE = 18;
+        static constexpr uint8_t FLAG_ALPHA = 1;
+        static constexpr uint8_t FLAG_LEVELS = 2;
+        static constexpr int LEVEL_CONTEXTS = 8;
+        static constexpr size_t READ_BUFFER = 1 << 16;
+
+    private:
+        static constexpr int PROB_BITS = 11;
+        static constexpr int MOVE_BITS = 5;
+        static constexpr uint32_t TOP = 1u << 24;
+
+        /**
+         * @brief Adaptive probabilities of the coded symbols
+         * @param color Binary trees of the green, red and blue differences, by level in the breadth-first layout
+         * @param split Split flag by level in the breadth-first layout
+         * @param alphaRepeat Repeat bit of an alpha pixel, by whether the previous pixel repeated
+         * @param alpha Binary tree of an alpha difference
+         */
+        struct Model {
+            uint16_t color[LEVEL_CONTEXTS][3][256];
+            uint16_t split[LEVEL_CONTEXTS];
+            uint16_t alphaRepeat[2];
+            uint16_t alpha[256];
+
+            Model() {
+                uint16_t half = 1 << (PROB_BITS - 1);
+                fill(&color[0][0][0], &color[0][0][0] + LEVEL_CONTEXTS * 3 * 256, half);
+                fill(split, split + LEVEL_CONTEXTS, half);
+                fill(alphaRepeat, alphaRepeat + 2, half);
+                fill(alpha, alpha + 256, half);
+            }
+        };
+
+        /**
+         * @brief Binary range encoder writing into a byte vector
+         */
+        struct Encoder {
+            vector<uint8_t>& out;
+            uint64_t low;
+            uint32_t range;
+            uint8_t cache;
+            uint64_t cacheSize;
+
+            Encoder(vector<uint8_t>& out) : out(out), low(0), range(0xFFFFFFFF), cache(0), cacheSize(1) {}
+
+            void shiftLow() {
+                if ((uint32_t)low < 0xFF000000u || (low >> 32) != 0) {
+                    uint8_t carry = (uint8_t)(low >> 32);
+                    uint8_t pending = cache;
+                    do {
+                        out.push_back((uint8_t)(pending + carry));
+                        pending = 0xFF;
+                    } while (--cacheSize != 0);
+                    cache = (uint8_t)(low >> 24);
+                }
+                cacheSize++;
+                low = (low & 0x00FFFFFF) << 8;
+            }
+
+            void encodeBit(uint16_t& prob, int bit) {
+                uint32_t bound = (range >> PROB_BITS) * prob;
+                if (bit == 0) {
+                    range = bound;
+                    prob += ((1 << PROB_BITS) - prob) >> MOVE_BITS;
+                }
+                else {
+                    low += bound;
+                    range -= bound;
+                    prob -= prob >> MOVE_BITS;
+                }
+                while (range < TOP) {
+                    range <<= 8;
+                    shiftLow();
+                }
+            }
+
+            void encodeByte(uint16_t tree[256], uint8_t value) {
+                int node = 1;
+                for (int b = 7; b >= 0; b--) {
+                    int bit = (value >> b) & 1;
+                    encodeBit(tree[node], bit);
+                    node = node * 2 + bit;
+                }
+            }
+
+            void flush() {
+                for (int i = 0; i < 5; i++) shiftLow();
+            }
+        };
+
+        /**
+         * @brief Binary range decoder reading the rest of a file through a fixed buffer, or one stream already in memory
+         *        Past the end it reads zeros, counting them in overrun
+         */
+        struct Decoder {
+            FILE* file;
+            vector<uint8_t> buffer;
+            size_t pos, size, overrun;
+            uint32_t range, code;
+
+            Decoder(FILE* file) : file(file), buffer(READ_BUFFER), pos(0), size(0), overrun(0), range(0xFFFFFFFF), code(0) {
+                for (int i = 0; i < 5; i++) code = (code << 8) | next();
+            }
+
+            Decoder(vector<uint8_t>&& stream) : file(nullptr), buffer(move(stream)), pos(0), size(buffer.size()), overrun(0), range(0xFFFFFFFF), code(0) {
+                for (int i = 0; i < 5; i++) code = (code << 8) | next();
+            }
+
+            uint8_t next() {
+                if (pos == size) {
+                    if (file) {
+                        size = fread(buffer.data(), 1, buffer.size(), file);
+                        pos = 0;
+                    }
+                    if (pos == size) {
+                        overrun++;
+                        return 0;
+                    }
+                }
+                return buffer[pos++];
+            }
+
+            int decodeBit(uint16_t& prob) {
+                uint32_t bound = (range >> PROB_BITS) * prob;
+                int bit;
+                if (code < bound) {
+                    range = bound;
+                    prob += ((1 << PROB_BITS) - prob) >> MOVE_BITS;
+                    bit = 0;
+                }
+                else {
+                    code -= bound;
+                    range -= bound;
+                    prob -= prob >> MOVE_BITS;
+                    bit = 1;
+                }
+                while (range < TOP) {
+                    range <<= 8;
+                    code = (code << 8) | next();
+                }
+                return bit;
+            }
+
+            uint8_t decodeByte(uint16_t tree[256]) {
+                int node = 1;
+                while (node < 256) node = node * 2 + decodeBit(tree[node]);
+                return (uint8_t)(node - 256);
+            }
+        };
+
+        /**
+         * @brief Region of a node waiting in the pre-order traversal
+         */
+        struct Region {
+            int x, y, width, height;
+        };
+
+        /**
+         * @brief Split a region in the split order of the quadtree
+         * @param r Region being split
+         * @param children Output children
+         */
+        static void splitRegion(const Region& r, Region children[4]) {
+            children[0] = {r.x, r.y, r.width / 2, r.height / 2};
+            children[1] = {r.x + r.height / 2, r.y, r.width / 2, r.height - r.height / 2};
+            children[2] = {r.x, r.y + r.width / 2, r.width - r.width / 2, r.height / 2};
+            children[3] = {r.x + r.height / 2, r.y + r.width / 2, r.width - r.width / 2, r.height - r.height / 2};
+        }
+
+        /**
+         * @brief Store a 32-bit value little-endian
+         * @param out Output bytes
+         * @param at Offset of the value
+         * @param value Value to store
+         */
+        static void putUint32(vector<uint8_t>& out, size_t at, uint32_t value) {
+            for (int i = 0; i < 4; i++) out[at + i] = (uint8_t)(value >> (8 * i));
+        }
+
+        /**
+         * @brief Read a 32-bit little-endian value
+         * @param in Bytes of the value
+         * @return Value
+         */
+        static uint32_t getUint32(const uint8_t* in) {
+            return (uint32_t)in[0] | (uint32_t)in[1] << 8 | (uint32_t)in[2] << 16 | (uint32_t)in[3] << 24;
+        }
+
+        /**
+         * @brief Start a file with its header
+         * @param out Output bytes
+         * @param width Width of the image in pixels
+         * @param height Height of the image in pixels
+         * @param channels Number of color channels of the image
+         * @param flags Header flags
+         * @param count Byte length of the split flags, or number of levels
+         */
+        static void writeHeader(vector<uint8_t>& out, int width, int height, int channels, uint8_t flags, uint32_t count) {
+            out.assign(HEADER_SIZE, 0);
+            out[0] = 'Q';
+            out[1] = 'T';
+            out[2] = 'Z';
+            out[3] = VERSION;
+            putUint32(out, 4, width);
+            putUint32(out, 8, height);
+            out[12] = (uint8_t)channels;
+            out[13] = flags;
+            putUint32(out, 14, count);
+        }
+
+        /**
+         * @brief Code a color as its difference from a prediction, red and blue relative to the green difference
+         * @param encoder Range encoder
+         * @param trees Binary trees of the green, red and blue differences
+         * @param color Color to code
+         * @param predicted Predicted color
+         */
+        static void encodeColor(Encoder& encoder, uint16_t trees[3][256], const uint8_t color[3], const uint8_t predicted[3]) {
+            uint8_t dG = color[1] - predicted[1];
+            encoder.encodeByte(trees[0], dG);
+            encoder.encodeByte(trees[1], (uint8_t)(color[0] - predicted[0] - dG));
+            encoder.encodeByte(trees[2], (uint8_t)(color[2] - predicted[2] - dG));
+        }
+
+        /**
+         * @brief Decode a color coded by encodeColor
+         * @param decoder Range decoder
+         * @param trees Binary trees of the green, red and blue differences
+         * @param color Predicted color, replaced by the decoded color
+         */
+        static void decodeColor(Decoder& decoder, uint16_t trees[3][256], uint8_t color[3]) {
+            uint8_t dG = decoder.decodeByte(trees[0]);
+            color[0] += decoder.decodeByte(trees[1]) + dG;
+            color[1] += dG;
+            color[2] += decoder.decodeByte(trees[2]) + dG;
+        }
+
+        /**
+         * @brief Code the alpha plane of an RGBA image
+         * @param encoder Range encoder
+         * @param model Probabilities of the alpha symbols
+         * @param image RGBA image data
+         * @param numPixels Number of pixels of the image
+         */
+        static void encodeAlpha(Encoder& encoder, Model& model, const unsigned char* image, size_t numPixels) {
+            uint8_t left = 0xFF;
+            int repeated = 1;
+            for (size_t i = 3; i < numPixels * 4; i += 4) {
+                int repeat = image[i] == left;
+                encoder.encodeBit(model.alphaRepeat[repeated], repeat);
+                if (!repeat) encoder.encodeByte(model.alpha, (uint8_t)(image[i] - left));
+                left = image[i];
+                repeated = repeat;
+            }
+        }
+
+        /**
+         * @brief Decode the alpha plane coded by encodeAlpha
+         * @param decoder Range decoder
+         * @param model Probabilities of the alpha symbols
+         * @param image RGBA image data whose alpha bytes are written
+         * @param numPixels Number of pixels of the image
+         */
+        static void decodeAlpha(Decoder& decoder, Model& model, unsigned char* image, size_t numPixels) {
+            uint8_t left = 0xFF;
+            int repeated = 1;
+            for (size_t i = 3; i < numPixels * 4; i += 4) {
+                int repeat = decoder.decodeBit(model.alphaRepeat[repeated]);
+                if (!repeat) left += decoder.decodeByte(model.alpha);
+                image[i] = left;
+                repeated = repeat;
+            }
+        }
+
+        /**
+         * @brief Append one range-coded stream after its 32-bit length
+         * @param out Output bytes
+         * @param stream Coded stream
+         */
+        static void appendStream(vector<uint8_t>& out, const vector<uint8_t>& stream) {
+            size_t at = out.size();
+            out.resize(at + 4);
+            putUint32(out, at, stream.size());
+            out.insert(out.end(), stream.begin(), stream.end());
+        }
+
+        /**
+         * @brief Read one range-coded stream after its 32-bit length, within a byte budget
+         * @param file Input file
+         * @param stream Output coded stream
+         * @param bytesRead Bytes of the file read so far, advanced by the stream
+         * @param maxBytes Byte budget of the whole file
+         * @return True if the whole stream was read within the budget
+         */
+        static bool readStream(FILE* file, vector<uint8_t>& stream, size_t& bytesRead, size_t maxBytes) {
+            uint8_t length[4];
+            if (bytesRead + 4 > maxBytes || fread(length, 1, 4, file) != 4) return false;
+
+            size_t size = getUint32(length);
+            if (bytesRead + 4 + size > maxBytes) return false;
+
+            stream.resize(size);
+            if (fread(stream.data(), 1, size, file) != size) return false;
+
+            bytesRead += 4 + size;
+            return true;
+        }
+
+        /**
+         * @brief Encode a quadtree in pre-order, split flags first and then the leaf colors
+         * @param tree Quadtree whose leaves are the painted blocks
+         * @param image Image data, only read for its alpha plane
+         * @param width Width of the image in pixels
+         * @param height Height of the image in pixels
+         * @param channels Number of color channels of the image
+         * @param storeAlpha Whether the alpha plane is stored
+         * @return Encoded file
+         */
+        static vector<uint8_t> encodePreOrder(const QuadTreeArena& tree, const unsigned char* image, int width, int height, int channels, bool storeAlpha) {
+            // Split flags of the nodes with pixels, in pre-order
+            vector<uint8_t> flags;
+            vector<uint32_t> leaves;
+            size_t bits = 0;
+            vector<uint32_t> stack = {0};
+            while (!stack.empty()) {
+                uint32_t index = stack.back();
+                stack.pop_back();
+
+                const QuadTreeArena::Node& node = tree[index];
+                if (node.width <= 0 || node.height <= 0) continue;
+
+                if (bits % 8 == 0) flags.push_back(0);
+                if (!tree.isLeaf(index)) {
+                    flags.back() |= 0x80 >> (bits % 8);
+                    for (int k = 3; k >= 0; k--) stack.push_back(node.firstChild + k);
+                }
+                else leaves.push_back(index);
+                bits++;
+            }
+
+            vector<uint8_t> out;
+            writeHeader(out, width, height, channels, storeAlpha ? FLAG_ALPHA : 0, flags.size());
+            out.insert(out.end(), flags.begin(), flags.end());
+
+            // Leaf colors as differences from the previous leaf
+            Model model;
+            Encoder encoder(out);
+            uint8_t last[3] = {0, 0, 0};
+            for (uint32_t index : leaves) {
+                encodeColor(encoder, model.color[0], tree[index].color, last);
+                memcpy(last, tree[index].color, 3);
+            }
+
+            if (storeAlpha) encodeAlpha(encoder, model, image, (size_t)width * height);
+
+            encoder.flush();
+            return out;
+        }
+
+        /**
+         * @brief Encode a quadtree breadth-first, one stream per level with the color and split flag of every node
+         * @param tree Quadtree whose leaves are the painted blocks
+         * @param image Image data, only read for its alpha plane
+         * @param width Width of the image in pixels
+         * @param height Height of the image in pixels
+         * @param channels Number of color channels of the image
+         * @param storeAlpha Whether the alpha plane is stored
+         * @return Encoded file
+         */
+        static vector<uint8_t> encodeLevels(const QuadTreeArena& tree, const unsigned char* image, int width, int height, int channels, bool storeAlpha) {
+            vector<uint8_t> out;
+            writeHeader(out, width, height, channels, FLAG_LEVELS | (storeAlpha ? FLAG_ALPHA : 0), 0);
+
+            Model model;
+            const uint8_t black[3] = {0, 0, 0};
+
+            // Nodes of the level with their parents, the root predicted from black
+            vector<pair<uint32_t, uint32_t>> level = {{0, QuadTreeArena::NO_CHILD}}, next;
+            uint32_t levels = 0;
+            while (!level.empty()) {
+                int context = min<int>(levels, LEVEL_CONTEXTS - 1);
+                vector<uint8_t> stream;
+                Encoder encoder(stream);
+                next.clear();
+
+                for (auto [index, parent] : level) {
+                    const QuadTreeArena::Node& node = tree[index];
+                    encodeColor(encoder, model.color[context], node.color, parent == QuadTreeArena::NO_CHILD ? black : tree[parent].color);
+
+                    bool split = !tree.isLeaf(index);
+                    encoder.encodeBit(model.split[context], split);
+                    if (!split) continue;
+
+                    for (uint32_t k = 0; k < 4; k++) {
+                        const QuadTreeArena::Node& child = tree[node.firstChild + k];
+                        if (child.width > 0 && child.height > 0) next.push_back({node.firstChild + k, index});
+                    }
+                }
+
+                encoder.flush();
+                appendStream(out, stream);
+                level.swap(next);
+                levels++;
+            }
+            putUint32(out, 14, levels);
+
+            if (storeAlpha) {
+                vector<uint8_t> stream;
+                Encoder encoder(stream);
+                encodeAlpha(encoder, model, image, (size_t)width * height);
+                encoder.flush();
+                appendStream(out, stream);
+            }
+
+            return out;
+        }
+
+        /**
+         * @brief Decode the pre-order layout, painting every leaf as soon as its color is read
+         * @param file Input file positioned after the header
+         * @param image Image data to paint
+         * @param width Width of the image in pixels
+         * @param height Height of the image in pixels
+         * @param channels Number of color channels of the image
+         * @param flagBytes Byte length of the split flags
+         * @param storeAlpha Whether the alpha plane follows the leaf colors
+         * @return Empty string if successful, error message if failed
+         */
+        static string decodePreOrder(FILE* file, vector<unsigned char>& image, int width, int height, int channels, size_t flagBytes, bool storeAlpha) {
+            vector<uint8_t> flags(flagBytes);
+            if (fread(flags.data(), 1, flags.size(), file) != flags.size()) return "File .qtz-nya kepotong.";
+
+            Model model;
+            Decoder decoder(file);
+            uint8_t last[3] = {0, 0, 0};
+            size_t bits = 0;
+            vector<Region> stack = {{0, 0, width, height}};
+            while (!stack.empty()) {
+                Region r = stack.back();
+                stack.pop_back();
+                if (r.width <= 0 || r.height <= 0) continue;
+
+                if (bits / 8 >= flags.size()) return "Split flag .qtz-nya kepotong.";
+                bool split = flags[bits / 8] & (0x80 >> (bits % 8));
+                bits++;
+
+                if (split) {
+                    Region children[4];
+                    splitRegion(r, children);
+                    for (int k = 3; k >= 0; k--) stack.push_back(children[k]);
+                    continue;
+                }
+
+                decodeColor(decoder, model.color[0], last);
+                QuadTreeNode::fillRectangle(image.data(), width, channels, r.x, r.y, r.width, r.height, last);
+            }
+
+            if (storeAlpha && channels == 4) decodeAlpha(decoder, model, image.data(), (size_t)width * height);
+
+            // A whole file ends exactly where the decoder stops reading, so any byte read past it was cut off
+            if (decoder.overrun > 0) return "File .qtz-nya kepotong.";
+            return "";
+        }
+
+        /**
+         * @brief Decode the breadth-first layout level by level, stopping at a depth, a byte budget, or the end of a truncated file
+         *        The root level is always decoded, the nodes of the first level left out are painted with their parent color
+         * @param file Input file positioned after the header
+         * @param image Image data to paint
+         * @param width Width of the image in pixels
+         * @param height Height of the image in pixels
+         * @param channels Number of color channels of the image
+         * @param levelCount Number of levels in the file
+         * @param storeAlpha Whether the alpha plane follows the last level
+         * @param maxDepth Deepest level decoded
+         * @param maxBytes Byte budget of the whole file, the header included
+         * @param fileSize Size of the whole file in bytes
+         */
+        static void decodeLevels(FILE* file, vector<unsigned char>& image, int width, int height, int channels, uint32_t levelCount, bool storeAlpha, int maxDepth, size_t maxBytes, size_t fileSize) {
+            struct Pending {
+                Region region;
+                uint8_t color[3];
+            };
+
+            Model model;
+            size_t bytesRead = HEADER_SIZE;
+
+            // Stream lengths are read from the file, so no stream is allocated past its end
+            maxBytes = min(maxBytes, fileSize);
+            vector<Pending> level = {{{0, 0, width, height}, {0, 0, 0}}}, next;
+            vector<uint8_t> stream;
+
+            uint32_t depth = 0;
+            for (; depth < levelCount && !level.empty(); depth++) {
+                bool withinLimits = depth == 0 || (int)depth <= maxDepth;
+                if (!withinLimits || !readStream(file, stream, bytesRead, depth == 0 ? fileSize : maxBytes)) break;
+
+                int context = min<int>(depth, LEVEL_CONTEXTS - 1);
+                Decoder decoder(move(stream));
+                next.clear();
+
+                for (Pending& node : level) {
+                    decodeColor(decoder, model.color[context], node.color);
+                    if (!decoder.decodeBit(model.split[context])) {
+                        const Region& r = node.region;
+                        QuadTreeNode::fillRectangle(image.data(), width, channels, r.x, r.y, r.width, r.height, node.color);
+                        continue;
+                    }
+
+                    Region children[4];
+                    splitRegion(node.region, children);
+                    for (int k = 0; k < 4; k++) {
+                        if (children[k].width > 0 && children[k].height > 0) next.push_back({children[k], {node.color[0], node.color[1], node.color[2]}});
+                    }
+                }
+
+                level.swap(next);
+            }
+
+            // The first level left out shows the colors of its parents
+            for (const Pending& node : level) {
+                const Region& r = node.region;
+                QuadTreeNode::fillRectangle(image.data(), width, channels, r.x, r.y, r.width, r.height, node.color);
+            }
+
+            if (depth == levelCount && level.empty() && storeAlpha && channels == 4 && readStream(file, stream, bytesRead, maxBytes)) {
+                Decoder decoder(move(stream));
+                decodeAlpha(decoder, model, image.data(), (size_t)width * height);
+            }
+        }
+
+    public:
+        /**
+         * @brief Encode a quadtree and the alpha plane of its image
+         * @param tree Quadtree whose leaves are the painted blocks, the root covering the whole image
+         * @param image Image data, only read for its alpha plane
+         * @param width Width of the image in pixels
+         * @param height Height of the image in pixels
+         * @param channels Number of color channels of the image, 3 or 4
+         * @param levels Whether the tree is laid out breadth-first, so that a prefix of the file decodes to a preview
+         * @return Encoded file, empty if the tree is empty
+         */
+        static vector<uint8_t> encode(const QuadTreeArena& tree, const unsigned char* image, int width, int height, int channels, bool levels = false) {
+            if (tree.empty()) return {};
+
+            bool storeAlpha = false;
+            if (channels == 4) {
+                for (size_t i = 3; i < (size_t)width * height * 4 && !storeAlpha; i += 4) storeAlpha = image[i] != 0xFF;
+            }
+
+            if (levels) return encodeLevels(tree, image, width, height, channels, storeAlpha);
+            return encodePreOrder(tree, image, width, height, channels, storeAlpha);
+        }
+
+        /**
+         * @brief Write an encoded quadtree to a file
+         * @param path Output .qtz path
+         * @param data Encoded file
+         * @return True if the whole file was written
+         */
+        static bool write(const string& path, const vector<uint8_t>& data) {
+            FILE* file = fopen(path.c_str(), "wb");
+            if (!file) return false;
+
+            bool written = fwrite(data.data(), 1, data.size(), file) == data.size();
+            return fclose(file) == 0 && written;
+        }
+
+        /**
+         * @brief Decode a .qtz file into an image
+         *        The pre-order layout is read through a fixed buffer and each leaf painted as soon as its color is read,
+         *        the breadth-first layout can stop early and still paint every pixel, with the colors of the last level read
+         * @param path Input .qtz path
+         * @param image Output image data, row-major without padding
+         * @param width Output width of the image in pixels
+         * @param height Output height of the image in pixels
+         * @param channels Output number of color channels, 3 or 4
+         * @param maxDepth Deepest level decoded, only for the breadth-first layout
+         * @param maxBytes Bytes of the file decoded at most, header included, only for the breadth-first layout
+         * @return Empty string if successful, error message if failed
+         */
+        static string decode(const string& path, vector<unsigned char>& image, int& width, int& height, int& channels, int maxDepth = INT_MAX, size_t maxBytes = SIZE_MAX) {
+            FILE* file = fopen(path.c_str(), "rb");
+            if (!file) return "File .qtz-nya gagal dibuka.";
+
+            fseek(file, 0, SEEK_END);
+            long end = ftell(file);
+            size_t fileSize = end < 0 ? 0 : (size_t)end;
+            fseek(file, 0, SEEK_SET);
+
+            uint8_t header[HEADER_SIZE];
+            string errorMsg;
+            if (fread(header, 1, HEADER_SIZE, file) != HEADER_SIZE || header[0] != 'Q' || header[1] != 'T' || header[2] != 'Z') {
+                errorMsg = "File-nya bukan .qtz.";
+            }
+            else if (header[3] != VERSION) {
+                errorMsg = "Versi .qtz-nya ga didukung: " + to_string(header[3]) + ".";
+            }
+            else {
+                width = getUint32(header + 4);
+                height = getUint32(header + 8);
+                channels = header[12];
+                bool storeAlpha = header[13] & FLAG_ALPHA;
+                bool levels = header[13] & FLAG_LEVELS;
+
+                // Only images stb_image can load are encoded, their buffers stay below INT_MAX bytes
+                if (width <= 0 || height <= 0 || channels < 3 || channels > 4 || (long long)width * height * channels > INT_MAX) errorMsg = "Header .qtz-nya rusak.";
+                else if (!levels && (maxDepth != INT_MAX || maxBytes != SIZE_MAX)) errorMsg = "File .qtz-nya bukan layout level, ga bisa di-decode sebagian.";
+                else if (!levels && getUint32(header + 14) > fileSize - HEADER_SIZE) errorMsg = "File .qtz-nya kepotong.";
+                else {
+                    // Opaque alpha, so painted RGBA pixels keep it unless the alpha plane follows
+                    image.assign((size_t)width * height * channels, channels == 4 ? 0xFF : 0);
+
+                    if (levels) decodeLevels(file, image, width, height, channels, getUint32(header + 14), storeAlpha, maxDepth, maxBytes, fileSize);
+                    else errorMsg = decodePreOrder(file, image, width, height, channels, getUint32(header + 14), storeAlpha);
+                }
+            }
+
+            fclose(file);
+            return errorMsg;
+        }
+};
+
+#endif
@@ -5,28 +5,6 @@
 #include "ErrorMethod.hpp"
 #include <tuple>
 
-/**
- * @brief Image data buffers used throughout the compression process
- * @param currImgData Current image data buffer used for processing
- * @param initImgData Initial image data buffer kept as reference
- * @param tempImgData Temporary image data buffer for intermediate processing
- */
-extern unsigned char *currImgData, *initImgData, *tempImgData;
-
-/**
- * @brief Global image dimensions and format information
- * @param imgWidth Width of the image in pixels
- * @param imgHeight Height of the image in pixels
- * @param imgChannels Number of color channels (typically 3 for RGB, 4 for RGBA)
- */
-extern int imgWidth, imgHeight, imgChannels;
-
-/**
- * @brief Global variable for error calculation method
- * @param errorMethod Pointer to the current error calculation method
- */
-ErrorMethod *errorMethod = nullptr;
-
 /**
  * @brief Represents a node in the quadtree for an image region
  * @param step Current depth/level in the quadtree
@@ -65,6 +43,7 @@ class QuadTreeNode {
 
         /**
          * @brief Parameterized constructor for QuadTreeNode
+         * @param ctx Image context whose error method measures the region
          * @param step Current depth/level in the quadtree
          * @param x X-coordinate of the region
          * @param y Y-coordinate of the region
@@ -72,7 +51,7 @@ class QuadTreeNode {
          * @param height Height of the region in pixels
          * @param mode Error calculation mode
          */
-        QuadTreeNode(int step, int x, int y, int width, int height, int mode) {
+        QuadTreeNode(ImageContext& ctx, int step, int x, int y, int width, int height, int mode) {
             this->step = step;
             this->x = x;
             this->y = y;
@@ -83,7 +62,7 @@ class QuadTreeNode {
             this->avgR = 0;
             this->avgG = 0;
             this->avgB = 0;
-            calculateError(mode);
+            calculateError(ctx);
         }
 
         /**
@@ -106,33 +85,14 @@ class QuadTreeNode {
         }
 
         /**
-         * @brief Calculate the error for this region using the specified error method
-         * @param mode Error calculation mode (1-5)
+         * @brief Calculate the error for this region using the error method of the image context
+         * @param ctx Image context whose error method measures the region
          */
-        void calculateError(int mode) {
-            if (errorMethod == nullptr) {
-                switch(mode) {
-                    case 1:
-                        errorMethod = new Variance();
-                        break;
-                    case 2:
-                        errorMethod = new MeanAbsoluteDeviation();
-                        break;
-                    case 3:
-                        errorMethod = new MaxPixelDifference();
-                        break;
-                    case 4:
-                        errorMethod = new Entropy();
-                        break;
-                    case 5:
-                        errorMethod = new SSIM();
-                        break;
-                }
-            }
+        void calculateError(ImageContext& ctx) {
+            ErrorMethod* errorMethod = ctx.errorMethod;
             
             if (errorMethod) {
-                setError(errorMethod->calculateError(currImgData, x, y, width, height));
-                setAvg(errorMethod->getAvgR(), errorMethod->getAvgG(), errorMethod->getAvgB());
+                error = errorMethod->calculateError(ctx.currImgData, x, y, width, height, avgR, avgG, avgB);
             }
             else {
                 cout << "Error: Error method not initialized." << endl;
@@ -140,34 +100,78 @@ class QuadTreeNode {
         }
 
         /**
-         * @brief Fill the rectangle region with the average RGB values
+         * @brief Fill a rectangle of an image with one color
+         *        RGB rows are painted once by doubling copies and then copied whole, RGBA pixels are painted as words that keep their alpha
          * @param image Pointer to the image data
+         * @param imgWidth Width of the image in pixels
+         * @param imgChannels Number of color channels of the image
+         * @param x Starting row
+         * @param y Starting column
+         * @param width Width of the rectangle in pixels
+         * @param height Height of the rectangle in pixels
+         * @param color RGB color to paint
          */
-        void fillRectangle(unsigned char* image) {
-            if (!image) return;
-
-            for (int i = x; i < x + height; ++i) {
-                for (int j = y; j < y + width; ++j) {
-                    int idx = (i * imgWidth + j) * imgChannels;
-                    image[idx] = static_cast<unsigned char>(avgR);
-                    image[idx + 1] = static_cast<unsigned char>(avgG);
-                    image[idx + 2] = static_cast<unsigned char>(avgB);
+        static void fillRectangle(unsigned char* image, int imgWidth, int imgChannels, int x, int y, int width, int height, const unsigned char color[3]) {
+            if (!image || width <= 0 || height <= 0) return;
+
+            size_t stride = (size_t)imgWidth * imgChannels;
+            unsigned char* first = image + ((size_t)x * imgWidth + y) * imgChannels;
+
+            if (imgChannels == 4) {
+                unsigned char rgbBytes[4] = {color[0], color[1], color[2], 0};
+                unsigned char alphaBytes[4] = {0, 0, 0, 0xFF};
+                uint32_t rgb, alpha;
+                memcpy(&rgb, rgbBytes, 4);
+                memcpy(&alpha, alphaBytes, 4);
+
+                for (int i = 0; i < height; i++) {
+                    unsigned char* pixel = first + i * stride;
+                    for (int j = 0; j < width; j++, pixel += 4) {
+                        uint32_t word;
+                        memcpy(&word, pixel, 4);
+                        word = (word & alpha) | rgb;
+                        memcpy(pixel, &word, 4);
+                    }
                 }
+                return;
+            }
+
+            // Paint the first row, doubling the painted span with each copy
+            size_t rowBytes = (size_t)width * imgChannels;
+            memcpy(first, color, 3);
+            for (size_t painted = imgChannels; painted < rowBytes; painted *= 2) {
+                memcpy(first + painted, first, min(painted, rowBytes - painted));
             }
+
+            for (int i = 1; i < height; i++) memcpy(first + i * stride, first, rowBytes);
+        }
+
+        /**
+         * @brief Fill the rectangle region with the average RGB values
+         * @param image Pointer to the image data
+         * @param imgWidth Width of the image in pixels
+         * @param imgChannels Number of color channels of the image
+         */
+        void fillRectangle(unsigned char* image, int imgWidth, int imgChannels) {
+            unsigned char color[3];
+            getColor(color);
+            fillRectangle(image, imgWidth, imgChannels, x, y, width, height, color);
         }
 
         /**
          * @brief Fill the current image data with the average color of this region
+         * @param ctx Image context to paint
          */
-        void fillCurrRectangle() {
-            fillRectangle(currImgData);
+        void fillCurrRectangle(ImageContext& ctx) {
+            fillRectangle(ctx.currImgData, ctx.imgWidth, ctx.imgChannels);
         }
 
         /**
          * @brief Fill the temporary image data with the average color of this region
+         * @param ctx Image context to paint
          */
-        void fillTempRectangle() {
-            fillRectangle(tempImgData);
+        void fillTempRectangle(ImageContext& ctx) {
+            fillRectangle(ctx.tempImgData, ctx.imgWidth, ctx.imgChannels);
         }
 
         /**
@@ -248,6 +252,16 @@ class QuadTreeNode {
             this->avgB = avgB;
         }
 
+        /**
+         * @brief Get the color painted for this region, the average RGB values truncated to bytes
+         * @param color Output RGB color
+         */
+        void getColor(unsigned char color[3]) {
+            color[0] = static_cast<unsigned char>(avgR);
+            color[1] = static_cast<unsigned char>(avgG);
+            color[2] = static_cast<unsigned char>(avgB);
+        }
+
         /**
          * @brief Get the error value for this region
          * @return Error value
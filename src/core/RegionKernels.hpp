@@ -0,0 +1,487 @@
+#ifndef REGIONKERNELS_HPP
+#define REGIONKERNELS_HPP
+
+// Libraries
+#include <stddef.h>
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define REGION_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+/**
+ * @brief Per-channel scans over a region of interleaved RGB or RGBA pixels, the scans the error methods cannot take from a table,
+ *        and the RGB to RGBA expansion of GIF frames
+ *        A row is processed in blocks of 16 (SSE2) or 32 (AVX2) pixels held in one register per channel of a pixel, so byte j of a
+ *        block always belongs to channel j % channels, and the leftover pixels of the row are scanned one by one
+ *        The AVX2 kernels are chosen at runtime by CPU feature detection, SSE2 is part of every x86-64 CPU, other CPUs scan scalar
+ * @param SCALAR Level of the pixel by pixel kernels
+ * @param SSE2 Level of the 16-byte register kernels
+ * @param AVX2 Level of the 32-byte register kernels
+ */
+class RegionKernels {
+
+    public:
+        static constexpr int SCALAR = 0;
+        static constexpr int SSE2 = 1;
+        static constexpr int AVX2 = 2;
+
+        /**
+         * @brief Get the widest kernel level the CPU runs, detected once
+         * @return SCALAR, SSE2 or AVX2
+         */
+        static int getLevel() {
+            static const int level = detectLevel();
+            return level;
+        }
+
+        /**
+         * @brief Sum each channel over a region
+         * @param image Pointer to image data
+         * @param imgWidth Width of the image in pixels
+         * @param channels Number of color channels of the image, 3 or 4
+         * @param x Starting row
+         * @param y Starting column
+         * @param width Width of the region
+         * @param height Height of the region
+         * @param sum Output sum of each channel
+         */
+        static void sum(const unsigned char* image, int imgWidth, int channels, int x, int y, int width, int height, long long sum[3]) {
+            sum[0] = sum[1] = sum[2] = 0;
+            int level = getLevel();
+
+            for (int i = x; i < x + height; i++) {
+                const unsigned char* pixel = image + ((size_t)i * imgWidth + y) * channels;
+                int done = 0;
+
+#ifdef REGION_KERNELS_X86
+                if (level == AVX2) done = sumRowAvx2(pixel, channels, width, sum);
+                else if (level == SSE2) done = sumRowSse2(pixel, channels, width, sum);
+#endif
+
+                for (pixel += (size_t)done * channels; done < width; done++, pixel += channels) {
+                    sum[0] += pixel[0];
+                    sum[1] += pixel[1];
+                    sum[2] += pixel[2];
+                }
+            }
+        }
+
+        /**
+         * @brief Combine the minimum, maximum and sum of each channel over a region into running values
+         * @param image Pointer to image data
+         * @param imgWidth Width of the image in pixels
+         * @param channels Number of color channels of the image, 3 or 4
+         * @param x Starting row
+         * @param y Starting column
+         * @param width Width of the region
+         * @param height Height of the region
+         * @param min Running minimum of each channel
+         * @param max Running maximum of each channel
+         * @param sum Running sum of each channel
+         */
+        static void minMax(const unsigned char* image, int imgWidth, int channels, int x, int y, int width, int height, unsigned char min[3], unsigned char max[3], long long sum[3]) {
+            int level = getLevel();
+
+            for (int i = x; i < x + height; i++) {
+                const unsigned char* pixel = image + ((size_t)i * imgWidth + y) * channels;
+                int done = 0;
+
+#ifdef REGION_KERNELS_X86
+                if (level == AVX2) done = minMaxRowAvx2(pixel, channels, width, min, max, sum);
+                else if (level == SSE2) done = minMaxRowSse2(pixel, channels, width, min, max, sum);
+#endif
+
+                for (pixel += (size_t)done * channels; done < width; done++, pixel += channels) {
+                    for (int c = 0; c < 3; c++) {
+                        min[c] = std::min(min[c], pixel[c]);
+                        max[c] = std::max(max[c], pixel[c]);
+                        sum[c] += pixel[c];
+                    }
+                }
+            }
+        }
+
+        /**
+         * @brief Sum the absolute deviations of each channel from its mean over a region, scaled by the region size
+         *        sum |n * v - sum| is twice the part above the mean, so it only needs the count and sum of the values above it
+         * @param image Pointer to image data
+         * @param imgWidth Width of the image in pixels
+         * @param channels Number of color channels of the image, 3 or 4
+         * @param x Starting row
+         * @param y Starting column
+         * @param width Width of the region
+         * @param height Height of the region
+         * @param sum Sum of each channel over the region
+         * @param absDev Output sum of |n * v - sum| of each channel
+         */
+        static void absDeviation(const unsigned char* image, int imgWidth, int channels, int x, int y, int width, int height, const long long sum[3], long long absDev[3]) {
+            long long n = (long long)width * height;
+            long long countAbove[3] = {0, 0, 0}, sumAbove[3] = {0, 0, 0};
+            unsigned char above[3];
+            int level = getLevel();
+
+            // A value is above the mean when it is at least floor(mean) + 1, a channel whose floor is 255 is flat
+            for (int c = 0; c < 3; c++) above[c] = (unsigned char)std::min(sum[c] / n + 1, 255LL);
+
+            for (int i = x; i < x + height; i++) {
+                const unsigned char* pixel = image + ((size_t)i * imgWidth + y) * channels;
+                int done = 0;
+
+#ifdef REGION_KERNELS_X86
+                if (level == AVX2) done = aboveRowAvx2(pixel, channels, width, above, countAbove, sumAbove);
+                else if (level == SSE2) done = aboveRowSse2(pixel, channels, width, above, countAbove, sumAbove);
+#endif
+
+                for (pixel += (size_t)done * channels; done < width; done++, pixel += channels) {
+                    for (int c = 0; c < 3; c++) {
+                        if (pixel[c] >= above[c]) {
+                            countAbove[c]++;
+                            sumAbove[c] += pixel[c];
+                        }
+                    }
+                }
+            }
+
+            for (int c = 0; c < 3; c++) {
+                absDev[c] = sum[c] / n >= 255 ? 0 : 2 * (n * sumAbove[c] - sum[c] * countAbove[c]);
+            }
+        }
+
+        /**
+         * @brief Expand RGB pixels to RGBA with an opaque alpha
+         * @param rgb Source pixels, 3 bytes each
+         * @param rgba Output pixels, 4 bytes each
+         * @param pixels Number of pixels
+         */
+        static void expandRgba(const unsigned char* rgb, unsigned char* rgba, size_t pixels) {
+            size_t done = 0;
+
+#ifdef REGION_KERNELS_X86
+            if (getLevel() == AVX2) done = expandRgbaAvx2(rgb, rgba, pixels);
+#endif
+
+            for (rgb += done * 3, rgba += done * 4; done < pixels; done++, rgb += 3, rgba += 4) {
+                rgba[0] = rgb[0];
+                rgba[1] = rgb[1];
+                rgba[2] = rgb[2];
+                rgba[3] = 255;
+            }
+        }
+
+    private:
+        /**
+         * @brief Detect the widest kernel level the CPU runs
+         * @return SCALAR, SSE2 or AVX2
+         */
+        static int detectLevel() {
+#ifdef REGION_KERNELS_X86
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2")) return AVX2;
+            if (__builtin_cpu_supports("sse2")) return SSE2;
+#endif
+            return SCALAR;
+        }
+
+        /**
+         * @brief Build the masks that pick the bytes of each color channel out of the registers of a block
+         * @param masks Output mask of register k and channel c at masks[(k * 3 + c) * bytes], 0xFF on the bytes of the channel
+         * @param channels Number of color channels of the image
+         * @param bytes Bytes in a register
+         */
+        static void buildChannelMasks(unsigned char* masks, int channels, int bytes) {
+            for (int k = 0; k < channels; k++) {
+                for (int c = 0; c < 3; c++) {
+                    for (int j = 0; j < bytes; j++) {
+                        masks[(k * 3 + c) * bytes + j] = (k * bytes + j) % channels == c ? 0xFF : 0;
+                    }
+                }
+            }
+        }
+
+#ifdef REGION_KERNELS_X86
+        /**
+         * @brief Sum the channels over the whole blocks of a row with SSE2
+         * @param pixel First pixel of the row
+         * @param channels Number of color channels of the image
+         * @param width Width of the row in pixels
+         * @param sum Running sum of each channel
+         * @return Number of pixels scanned
+         */
+        static int sumRowSse2(const unsigned char* pixel, int channels, int width, long long sum[3]) {
+            int blocks = width / 16;
+            if (blocks == 0) return 0;
+
+            alignas(16) unsigned char masks[4 * 3 * 16];
+            buildChannelMasks(masks, channels, 16);
+            __m128i zero = _mm_setzero_si128();
+            __m128i acc[3] = {zero, zero, zero};
+
+            for (int b = 0; b < blocks; b++, pixel += 16 * channels) {
+                for (int k = 0; k < channels; k++) {
+                    __m128i v = _mm_loadu_si128((const __m128i*)(pixel + 16 * k));
+                    for (int c = 0; c < 3; c++) {
+                        __m128i mask = _mm_load_si128((const __m128i*)(masks + (k * 3 + c) * 16));
+                        acc[c] = _mm_add_epi64(acc[c], _mm_sad_epu8(_mm_and_si128(v, mask), zero));
+                    }
+                }
+            }
+
+            for (int c = 0; c < 3; c++) {
+                alignas(16) long long lanes[2];
+                _mm_store_si128((__m128i*)lanes, acc[c]);
+                sum[c] += lanes[0] + lanes[1];
+            }
+            return blocks * 16;
+        }
+
+        /**
+         * @brief Sum the channels over the whole blocks of a row with AVX2
+         * @param pixel First pixel of the row
+         * @param channels Number of color channels of the image
+         * @param width Width of the row in pixels
+         * @param sum Running sum of each channel
+         * @return Number of pixels scanned
+         */
+        __attribute__((target("avx2")))
+        static int sumRowAvx2(const unsigned char* pixel, int channels, int width, long long sum[3]) {
+            int blocks = width / 32;
+            if (blocks == 0) return sumRowSse2(pixel, channels, width, sum);
+
+            alignas(32) unsigned char masks[4 * 3 * 32];
+            buildChannelMasks(masks, channels, 32);
+            __m256i zero = _mm256_setzero_si256();
+            __m256i acc[3] = {zero, zero, zero};
+
+            for (int b = 0; b < blocks; b++, pixel += 32 * channels) {
+                for (int k = 0; k < channels; k++) {
+                    __m256i v = _mm256_loadu_si256((const __m256i*)(pixel + 32 * k));
+                    for (int c = 0; c < 3; c++) {
+                        __m256i mask = _mm256_load_si256((const __m256i*)(masks + (k * 3 + c) * 32));
+                        acc[c] = _mm256_add_epi64(acc[c], _mm256_sad_epu8(_mm256_and_si256(v, mask), zero));
+                    }
+                }
+            }
+
+            for (int c = 0; c < 3; c++) {
+                alignas(32) long long lanes[4];
+                _mm256_store_si256((__m256i*)lanes, acc[c]);
+                sum[c] += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+            }
+            return blocks * 32 + sumRowSse2(pixel, channels, width - blocks * 32, sum);
+        }
+
+        /**
+         * @brief Combine the minimum, maximum and sum of the channels over the whole blocks of a row with SSE2
+         * @param pixel First pixel of the row
+         * @param channels Number of color channels of the image
+         * @param width Width of the row in pixels
+         * @param min Running minimum of each channel
+         * @param max Running maximum of each channel
+         * @param sum Running sum of each channel
+         * @return Number of pixels scanned
+         */
+        static int minMaxRowSse2(const unsigned char* pixel, int channels, int width, unsigned char min[3], unsigned char max[3], long long sum[3]) {
+            int blocks = width / 16;
+            if (blocks == 0) return 0;
+
+            __m128i low[4], high[4];
+            for (int k = 0; k < channels; k++) {
+                low[k] = _mm_set1_epi8((char)0xFF);
+                high[k] = _mm_setzero_si128();
+            }
+
+            const unsigned char* start = pixel;
+            for (int b = 0; b < blocks; b++, pixel += 16 * channels) {
+                for (int k = 0; k < channels; k++) {
+                    __m128i v = _mm_loadu_si128((const __m128i*)(pixel + 16 * k));
+                    low[k] = _mm_min_epu8(low[k], v);
+                    high[k] = _mm_max_epu8(high[k], v);
+                }
+            }
+
+            for (int k = 0; k < channels; k++) {
+                alignas(16) unsigned char lowBytes[16], highBytes[16];
+                _mm_store_si128((__m128i*)lowBytes, low[k]);
+                _mm_store_si128((__m128i*)highBytes, high[k]);
+
+                for (int j = 0; j < 16; j++) {
+                    int c = (k * 16 + j) % channels;
+                    if (c == 3) continue;
+                    min[c] = std::min(min[c], lowBytes[j]);
+                    max[c] = std::max(max[c], highBytes[j]);
+                }
+            }
+
+            return sumRowSse2(start, channels, blocks * 16, sum);
+        }
+
+        /**
+         * @brief Combine the minimum, maximum and sum of the channels over the whole blocks of a row with AVX2
+         * @param pixel First pixel of the row
+         * @param channels Number of color channels of the image
+         * @param width Width of the row in pixels
+         * @param min Running minimum of each channel
+         * @param max Running maximum of each channel
+         * @param sum Running sum of each channel
+         * @return Number of pixels scanned
+         */
+        __attribute__((target("avx2")))
+        static int minMaxRowAvx2(const unsigned char* pixel, int channels, int width, unsigned char min[3], unsigned char max[3], long long sum[3]) {
+            int blocks = width / 32;
+            if (blocks == 0) return minMaxRowSse2(pixel, channels, width, min, max, sum);
+
+            __m256i low[4], high[4];
+            for (int k = 0; k < channels; k++) {
+                low[k] = _mm256_set1_epi8((char)0xFF);
+                high[k] = _mm256_setzero_si256();
+            }
+
+            const unsigned char* start = pixel;
+            for (int b = 0; b < blocks; b++, pixel += 32 * channels) {
+                for (int k = 0; k < channels; k++) {
+                    __m256i v = _mm256_loadu_si256((const __m256i*)(pixel + 32 * k));
+                    low[k] = _mm256_min_epu8(low[k], v);
+                    high[k] = _mm256_max_epu8(high[k], v);
+                }
+            }
+
+            for (int k = 0; k < channels; k++) {
+                alignas(32) unsigned char lowBytes[32], highBytes[32];
+                _mm256_store_si256((__m256i*)lowBytes, low[k]);
+                _mm256_store_si256((__m256i*)highBytes, high[k]);
+
+                for (int j = 0; j < 32; j++) {
+                    int c = (k * 32 + j) % channels;
+                    if (c == 3) continue;
+                    min[c] = std::min(min[c], lowBytes[j]);
+                    max[c] = std::max(max[c], highBytes[j]);
+                }
+            }
+
+            sumRowAvx2(start, channels, blocks * 32, sum);
+            return blocks * 32 + minMaxRowSse2(pixel, channels, width - blocks * 32, min, max, sum);
+        }
+
+        /**
+         * @brief Count and sum the values of each channel at or above a bound over the whole blocks of a row with SSE2
+         * @param pixel First pixel of the row
+         * @param channels Number of color channels of the image
+         * @param width Width of the row in pixels
+         * @param above Bound of each channel
+         * @param countAbove Running count of the values at or above the bound
+         * @param sumAbove Running sum of the values at or above the bound
+         * @return Number of pixels scanned
+         */
+        static int aboveRowSse2(const unsigned char* pixel, int channels, int width, const unsigned char above[3], long long countAbove[3], long long sumAbove[3]) {
+            int blocks = width / 16;
+            if (blocks == 0) return 0;
+
+            alignas(16) unsigned char masks[4 * 3 * 16], bounds[4 * 16];
+            buildChannelMasks(masks, channels, 16);
+            for (int j = 0; j < channels * 16; j++) bounds[j] = j % channels == 3 ? 0xFF : above[j % channels];
+
+            __m128i zero = _mm_setzero_si128();
+            __m128i one = _mm_set1_epi8(1);
+            __m128i count[3] = {zero, zero, zero}, total[3] = {zero, zero, zero};
+
+            for (int b = 0; b < blocks; b++, pixel += 16 * channels) {
+                for (int k = 0; k < channels; k++) {
+                    __m128i v = _mm_loadu_si128((const __m128i*)(pixel + 16 * k));
+                    __m128i bound = _mm_load_si128((const __m128i*)(bounds + 16 * k));
+                    __m128i hit = _mm_cmpeq_epi8(_mm_max_epu8(v, bound), v);
+                    __m128i hitValue = _mm_and_si128(v, hit);
+                    __m128i hitOne = _mm_and_si128(one, hit);
+
+                    for (int c = 0; c < 3; c++) {
+                        __m128i mask = _mm_load_si128((const __m128i*)(masks + (k * 3 + c) * 16));
+                        total[c] = _mm_add_epi64(total[c], _mm_sad_epu8(_mm_and_si128(hitValue, mask), zero));
+                        count[c] = _mm_add_epi64(count[c], _mm_sad_epu8(_mm_and_si128(hitOne, mask), zero));
+                    }
+                }
+            }
+
+            for (int c = 0; c < 3; c++) {
+                alignas(16) long long lanes[2];
+                _mm_store_si128((__m128i*)lanes, total[c]);
+                sumAbove[c] += lanes[0] + lanes[1];
+                _mm_store_si128((__m128i*)lanes, count[c]);
+                countAbove[c] += lanes[0] + lanes[1];
+            }
+            return blocks * 16;
+        }
+
+        /**
+         * @brief Count and sum the values of each channel at or above a bound over the whole blocks of a row with AVX2
+         * @param pixel First pixel of the row
+         * @param channels Number of color channels of the image
+         * @param width Width of the row in pixels
+         * @param above Bound of each channel
+         * @param countAbove Running count of the values at or above the bound
+         * @param sumAbove Running sum of the values at or above the bound
+         * @return Number of pixels scanned
+         */
+        __attribute__((target("avx2")))
+        static int aboveRowAvx2(const unsigned char* pixel, int channels, int width, const unsigned char above[3], long long countAbove[3], long long sumAbove[3]) {
+            int blocks = width / 32;
+            if (blocks == 0) return aboveRowSse2(pixel, channels, width, above, countAbove, sumAbove);
+
+            alignas(32) unsigned char masks[4 * 3 * 32], bounds[4 * 32];
+            buildChannelMasks(masks, channels, 32);
+            for (int j = 0; j < channels * 32; j++) bounds[j] = j % channels == 3 ? 0xFF : above[j % channels];
+
+            __m256i zero = _mm256_setzero_si256();
+            __m256i one = _mm256_set1_epi8(1);
+            __m256i count[3] = {zero, zero, zero}, total[3] = {zero, zero, zero};
+
+            for (int b = 0; b < blocks; b++, pixel += 32 * channels) {
+                for (int k = 0; k < channels; k++) {
+                    __m256i v = _mm256_loadu_si256((const __m256i*)(pixel + 32 * k));
+                    __m256i bound = _mm256_load_si256((const __m256i*)(bounds + 32 * k));
+                    __m256i hit = _mm256_cmpeq_epi8(_mm256_max_epu8(v, bound), v);
+                    __m256i hitValue = _mm256_and_si256(v, hit);
+                    __m256i hitOne = _mm256_and_si256(one, hit);
+
+                    for (int c = 0; c < 3; c++) {
+                        __m256i mask = _mm256_load_si256((const __m256i*)(masks + (k * 3 + c) * 32));
+                        total[c] = _mm256_add_epi64(total[c], _mm256_sad_epu8(_mm256_and_si256(hitValue, mask), zero));
+                        count[c] = _mm256_add_epi64(count[c], _mm256_sad_epu8(_mm256_and_si256(hitOne, mask), zero));
+                    }
+                }
+            }
+
+            for (int c = 0; c < 3; c++) {
+                alignas(32) long long lanes[4];
+                _mm256_store_si256((__m256i*)lanes, total[c]);
+                sumAbove[c] += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+                _mm256_store_si256((__m256i*)lanes, count[c]);
+                countAbove[c] += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+            }
+            return blocks * 32 + aboveRowSse2(pixel, channels, width - blocks * 32, above, countAbove, sumAbove);
+        }
+
+        /**
+         * @brief Expand RGB pixels to RGBA four at a time with byte shuffles, which AVX2 CPUs always have
+         *        Every 16-byte load covers four pixels and reads four bytes past them, so the last few pixels are left to the caller
+         * @param rgb Source pixels, 3 bytes each
+         * @param rgba Output pixels, 4 bytes each
+         * @param pixels Number of pixels
+         * @return Number of pixels expanded
+         */
+        __attribute__((target("avx2")))
+        static size_t expandRgbaAvx2(const unsigned char* rgb, unsigned char* rgba, size_t pixels) {
+            const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+            const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+            size_t done = 0;
+
+            for (; done + 6 <= pixels; done += 4, rgb += 12, rgba += 16) {
+                __m128i v = _mm_loadu_si128((const __m128i*)rgb);
+                _mm_storeu_si128((__m128i*)rgba, _mm_or_si128(_mm_shuffle_epi8(v, shuffle), alpha));
+            }
+            return done;
+        }
+#endif
+};
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef SIZEESTIMATOR_HPP
+#define SIZEESTIMATOR_HPP
+
+// Libraries
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+/**
+ * @brief Predicts the encoded size of a quadtree image from its leaf edges, calibrated with real encodes of the same image
+ *        Flat blocks cost almost nothing to encode, the bytes go to the rows and columns where one block meets another,
+ *        so the encoded size grows with the sum of width + height over the leaves
+ * @param CALIBRATION_SAMPLES Number of real encodes taken before predicting
+ * @param CONFIRM_ROUNDS Maximum number of real encodes spent confirming a predicted threshold
+ * @param samples Real (leaf edges, encoded size) pairs, sorted by leaf edges
+ */
+class SizeEstimator {
+
+    private:
+        vector<pair<long long, size_t>> samples;
+
+    public:
+        static constexpr int CALIBRATION_SAMPLES = 3;
+        static constexpr int CONFIRM_ROUNDS = 3;
+
+        /**
+         * @brief Add the size of a real encode
+         * @param leafEdges Sum of width + height over the leaves of the encoded image
+         * @param size Encoded size in bytes
+         */
+        void addSample(long long leafEdges, size_t size) {
+            auto it = lower_bound(samples.begin(), samples.end(), make_pair(leafEdges, (size_t)0));
+            if (it != samples.end() && it -> first == leafEdges) it -> second = size;
+            else samples.insert(it, {leafEdges, size});
+        }
+
+        /**
+         * @brief Check whether enough real encodes were taken to predict
+         * @return True once CALIBRATION_SAMPLES samples were added
+         */
+        bool isCalibrated() const {
+            return (int)samples.size() >= CALIBRATION_SAMPLES;
+        }
+
+        /**
+         * @brief Predict the encoded size, interpolating between the two nearest samples and extrapolating past the ends
+         * @param leafEdges Sum of width + height over the leaves
+         * @return Predicted encoded size in bytes
+         */
+        size_t predict(long long leafEdges) const {
+            if (samples.empty()) return 0;
+            if (samples.size() == 1) {
+                if (samples[0].first == 0) return samples[0].second;
+                return samples[0].second * ((double)leafEdges / samples[0].first);
+            }
+
+            size_t hi = lower_bound(samples.begin(), samples.end(), make_pair(leafEdges, (size_t)0)) - samples.begin();
+            hi = min(max(hi, (size_t)1), samples.size() - 1);
+            const auto& a = samples[hi - 1];
+            const auto& b = samples[hi];
+
+            double slope = ((double)b.second - (double)a.second) / (b.first - a.first);
+            double size = a.second + slope * (leafEdges - a.first);
+            return size > 0 ? (size_t)size : 0;
+        }
+};
+
+#endif
@@ -0,0 +1,213 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+// Libraries
+#include <atomic>
+#include <chrono>
+#include <ostream>
+
+using namespace std;
+
+/**
+ * @brief Wall-clock time of every phase of a compression and counters of the work the quadtree did, filled while it runs
+ *        Every field is atomic, so the threads of a parallel or tiled build add to the same object,
+ *        the time of a phase that runs on several threads at once is the sum of their times
+ * @param PHASE_NAMES Name of every phase, as written in the JSON output
+ * @param phaseNanos Time spent in every phase in nanoseconds
+ * @param phaseCalls Number of times every phase was entered
+ * @param mode Error calculation mode (1-5) of the compression, 0 before it is known
+ * @param nodesVisited Nodes visited by the builds, and by every cut of the target search
+ * @param leaves Leaves among the visited nodes
+ * @param regionsMeasured Regions measured by the error method
+ * @param pixelsScanned Pixels of the measured regions the error method read one by one
+ * @param pixelsFromTables Pixels of the measured regions the error method answered from its tables
+ */
+class CompressionStats {
+
+    public:
+        enum Phase {DECODE, CALIBRATION, TABLE_BUILD, ERROR_EVALUATION, LEAF_FILL, GIF_ENCODE, OUTPUT_ENCODE, SIZE_PROBE, PHASE_COUNT};
+
+        static constexpr const char* PHASE_NAMES[PHASE_COUNT] = {
+            "decode", "calibration", "table_build", "error_evaluation", "leaf_fill", "gif_encode", "output_encode", "size_probe"
+        };
+
+        /**
+         * @brief Adds the time from its construction to its destruction to a phase, does nothing without stats
+         * @param stats Stats the time is added to, nullptr for none
+         * @param phase Phase timed
+         * @param start Time the phase was entered
+         */
+        class Timer {
+
+            private:
+                CompressionStats* stats;
+                Phase phase;
+                chrono::steady_clock::time_point start;
+
+            public:
+                /**
+                 * @brief Constructor that starts the timer
+                 * @param stats Stats the time is added to, nullptr for none
+                 * @param phase Phase timed
+                 */
+                Timer(CompressionStats* stats, Phase phase) : stats(stats), phase(phase) {
+                    if (stats != nullptr) start = chrono::steady_clock::now();
+                }
+
+                Timer(const Timer&) = delete;
+                Timer& operator=(const Timer&) = delete;
+
+                /**
+                 * @brief Destructor that adds the elapsed time
+                 */
+                ~Timer() {
+                    if (stats != nullptr) stats -> addTime(phase, chrono::steady_clock::now() - start);
+                }
+        };
+
+    private:
+        atomic<long long> phaseNanos[PHASE_COUNT], phaseCalls[PHASE_COUNT];
+        atomic<int> mode;
+        atomic<long long> nodesVisited, leaves, regionsMeasured, pixelsScanned, pixelsFromTables;
+
+    public:
+        /**
+         * @brief Constructor that starts every phase and counter at zero
+         */
+        CompressionStats() {
+            reset();
+        }
+
+        CompressionStats(const CompressionStats&) = delete;
+        CompressionStats& operator=(const CompressionStats&) = delete;
+
+        /**
+         * @brief Set every phase and counter back to zero
+         */
+        void reset() {
+            for (int p = 0; p < PHASE_COUNT; p++) {
+                phaseNanos[p] = 0;
+                phaseCalls[p] = 0;
+            }
+            mode = 0;
+            nodesVisited = 0;
+            leaves = 0;
+            regionsMeasured = 0;
+            pixelsScanned = 0;
+            pixelsFromTables = 0;
+        }
+
+        /**
+         * @brief Add time to a phase
+         * @param phase Phase the time was spent in
+         * @param elapsed Time spent
+         */
+        void addTime(Phase phase, chrono::steady_clock::duration elapsed) {
+            phaseNanos[phase] += chrono::duration_cast<chrono::nanoseconds>(elapsed).count();
+            phaseCalls[phase]++;
+        }
+
+        /**
+         * @brief Add nodes visited by a build or a cut
+         * @param visited Nodes visited
+         * @param leafCount Leaves among them
+         */
+        void addNodes(long long visited, long long leafCount) {
+            nodesVisited += visited;
+            leaves += leafCount;
+        }
+
+        /**
+         * @brief Add regions measured by the error method
+         * @param regions Regions measured
+         * @param scanned Pixels read one by one
+         * @param fromTables Pixels answered from the tables of the error method
+         */
+        void addRegions(long long regions, long long scanned, long long fromTables) {
+            regionsMeasured += regions;
+            pixelsScanned += scanned;
+            pixelsFromTables += fromTables;
+        }
+
+        /**
+         * @brief Set the error calculation mode the counters belong to
+         * @param mode Error calculation mode (1-5)
+         */
+        void setMode(int mode) {
+            this -> mode = mode;
+        }
+
+        /**
+         * @brief Get the time spent in a phase
+         * @param phase Phase
+         * @return Time in milliseconds
+         */
+        double getPhaseTime(Phase phase) const {
+            return phaseNanos[phase] / 1e6;
+        }
+
+        /**
+         * @brief Get the number of times a phase was entered
+         * @param phase Phase
+         * @return Call count
+         */
+        long long getPhaseCalls(Phase phase) const {return phaseCalls[phase];}
+
+        /**
+         * @brief Get the error calculation mode the counters belong to
+         * @return Error calculation mode, 0 if none was set
+         */
+        int getMode() const {return mode;}
+
+        /**
+         * @brief Get the nodes visited by the builds and cuts
+         * @return Visited node count
+         */
+        long long getNodesVisited() const {return nodesVisited;}
+
+        /**
+         * @brief Get the leaves among the visited nodes
+         * @return Leaf count
+         */
+        long long getLeaves() const {return leaves;}
+
+        /**
+         * @brief Get the regions measured by the error method
+         * @return Measured region count
+         */
+        long long getRegionsMeasured() const {return regionsMeasured;}
+
+        /**
+         * @brief Get the pixels the error method read one by one
+         * @return Scanned pixel count
+         */
+        long long getPixelsScanned() const {return pixelsScanned;}
+
+        /**
+         * @brief Get the pixels the error method answered from its tables
+         * @return Pixel count covered by table lookups
+         */
+        long long getPixelsFromTables() const {return pixelsFromTables;}
+
+        /**
+         * @brief Write the phases and counters as one JSON object
+         * @param out Output stream
+         */
+        void writeJson(ostream& out) const {
+            out << "{" << endl << "  \"phases\": {";
+            for (int p = 0; p < PHASE_COUNT; p++) {
+                out << (p == 0 ? "" : ",") << endl << "    \"" << PHASE_NAMES[p] << "\": {\"ms\": " << getPhaseTime((Phase)p)
+                    << ", \"calls\": " << getPhaseCalls((Phase)p) << "}";
+            }
+            out << endl << "  }," << endl;
+            out << "  \"mode\": " << getMode() << "," << endl;
+            out << "  \"nodes_visited\": " << getNodesVisited() << "," << endl;
+            out << "  \"leaves\": " << getLeaves() << "," << endl;
+            out << "  \"regions_measured\": " << getRegionsMeasured() << "," << endl;
+            out << "  \"pixels_scanned\": " << getPixelsScanned() << "," << endl;
+            out << "  \"pixels_from_tables\": " << getPixelsFromTables() << endl;
+            out << "}" << endl;
+        }
+};
+
+#endif
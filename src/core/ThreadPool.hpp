@@ -0,0 +1,173 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+// Libraries
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief Work-stealing thread pool, each worker takes its newest task first and steals the oldest task of another worker when idle
+ * @param workers Background worker threads, the thread calling run() works as worker 0
+ * @param queues Task queue of every worker
+ * @param pending Number of submitted tasks that have not finished yet
+ * @param queued Number of tasks waiting in the queues, not taken by any worker yet
+ * @param stopping Flag that tells the background workers to exit
+ * @param idleLock Lock of the idle workers, held while changing what they wait for
+ * @param idle Signals the idle workers of a new task, the caller of run() of the last finished task, and all of them of stopping
+ * @param workerIndex Index of the worker running on the current thread, -1 outside the pool
+ */
+class ThreadPool {
+
+    private:
+        struct TaskQueue {
+            deque<function<void()>> tasks;
+            mutex lock;
+        };
+
+        vector<thread> workers;
+        vector<unique_ptr<TaskQueue>> queues;
+        atomic<int> pending, queued;
+        atomic<bool> stopping;
+        mutex idleLock;
+        condition_variable idle;
+
+        inline static thread_local int workerIndex = -1;
+
+        /**
+         * @brief Take one task, from the back of the own queue or else from the front of another queue
+         * @param self Index of the worker looking for a task
+         * @param task Output task
+         * @return True if a task was found
+         */
+        bool takeTask(int self, function<void()>& task) {
+            int count = queues.size();
+
+            for (int k = 0; k < count; k++) {
+                int victim = (self + k) % count;
+                TaskQueue& queue = *queues[victim];
+                lock_guard<mutex> guard(queue.lock);
+                if (queue.tasks.empty()) continue;
+
+                if (k == 0) {
+                    task = move(queue.tasks.back());
+                    queue.tasks.pop_back();
+                }
+                else {
+                    task = move(queue.tasks.front());
+                    queue.tasks.pop_front();
+                }
+                queued--;
+                return true;
+            }
+
+            return false;
+        }
+
+        /**
+         * @brief Run one task if there is any
+         * @param self Index of the worker running the task
+         * @return True if a task was run
+         */
+        bool runOne(int self) {
+            function<void()> task;
+            if (!takeTask(self, task)) return false;
+
+            task();
+            if (--pending == 0) {
+                lock_guard<mutex> guard(idleLock);
+                idle.notify_all();
+            }
+            return true;
+        }
+
+        /**
+         * @brief Sleep until a task is queued, or until the pool stops
+         */
+        void waitForTask() {
+            unique_lock<mutex> guard(idleLock);
+            idle.wait(guard, [this]() { return stopping || queued > 0; });
+        }
+
+    public:
+        /**
+         * @brief Constructor that starts the background workers
+         * @param threads Total number of threads working on tasks, including the thread calling run()
+         */
+        ThreadPool(int threads) : pending(0), queued(0), stopping(false) {
+            if (threads < 1) threads = 1;
+
+            for (int i = 0; i < threads; i++) queues.push_back(make_unique<TaskQueue>());
+
+            for (int i = 1; i < threads; i++) {
+                workers.emplace_back([this, i]() {
+                    workerIndex = i;
+                    while (!stopping) {
+                        if (!runOne(i)) waitForTask();
+                    }
+                });
+            }
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        /**
+         * @brief Destructor that stops and joins the background workers
+         */
+        ~ThreadPool() {
+            {
+                lock_guard<mutex> guard(idleLock);
+                stopping = true;
+            }
+            idle.notify_all();
+            for (auto& worker : workers) worker.join();
+        }
+
+        /**
+         * @brief Queue a task on the queue of the current worker, callable from inside a running task
+         * @param task Task to run
+         */
+        void submit(function<void()> task) {
+            int self = workerIndex >= 0 ? workerIndex : 0;
+            pending++;
+
+            {
+                lock_guard<mutex> guard(queues[self] -> lock);
+                queues[self] -> tasks.push_back(move(task));
+            }
+            queued++;
+
+            // Taking the lock orders the new task before any worker that just found nothing goes to sleep
+            { lock_guard<mutex> guard(idleLock); }
+            idle.notify_one();
+        }
+
+        /**
+         * @brief Run a task and every task it submits, working on the calling thread until all of them finish
+         * @param task Root task
+         */
+        void run(function<void()> task) {
+            int previousIndex = workerIndex;
+            workerIndex = 0;
+
+            submit(move(task));
+            while (pending > 0) {
+                if (runOne(0)) continue;
+
+                unique_lock<mutex> guard(idleLock);
+                idle.wait(guard, [this]() { return pending == 0 || queued > 0; });
+            }
+
+            workerIndex = previousIndex;
+        }
+};
+
+#endif
@@ -0,0 +1,63 @@
+// The core headers define the stb and gif implementations, so the library is its own translation unit
+#include "Quadpressor.hpp"
+#include "../core/QuadTree.hpp"
+
+CompressionResult Quadpressor::compress(const unsigned char* pixels, int width, int height, int channels, int mode, double threshold, int minBlock, double targetPercentage, const std::string& format, int quality, int threads) {
+    CompressionResult result;
+
+    double lowerThreshold = 0.0, upperThreshold = 0.0;
+    ErrorMethod::getThresholdRange(mode, lowerThreshold, upperThreshold);
+
+    if (mode < 1 || mode > 5) {
+        result.errorMessage = "Mode harus angka 1 sampai 5.";
+        return result;
+    }
+    if (targetPercentage == 0 && (threshold < lowerThreshold || threshold > upperThreshold)) {
+        result.errorMessage = "Threshold harus di rentang " + to_string(lowerThreshold) + " - " + to_string(upperThreshold) + ".";
+        return result;
+    }
+    if (targetPercentage < 0 || targetPercentage > 1) {
+        result.errorMessage = "Target harus di rentang 0.0 sampai 1.0.";
+        return result;
+    }
+    if (format != "png" && format != "jpg" && format != "jpeg") {
+        result.errorMessage = "Format harus png atau jpg.";
+        return result;
+    }
+    if (minBlock < 1 || (long long)minBlock > (long long)width * height) {
+        result.errorMessage = "Minimum block size harus bilangan bulat positif dan ga lebih dari luas image.";
+        return result;
+    }
+
+    ImageContext ctx;
+    string errorMsg = Image::loadImageFromMemory(ctx, pixels, width, height, channels, quality);
+    if (!errorMsg.empty()) {
+        result.errorMessage = errorMsg;
+        return result;
+    }
+
+    QuadTree qt(ctx, "", mode, threshold, minBlock, targetPercentage, "", "", format);
+    qt.setInitialSize(Image::getEncodedSize(ctx.initImgData, width, height, format, channels, quality));
+    qt.setThreads(threads);
+
+    if (targetPercentage == 0) qt.performQuadTree();
+    else qt.performBinserQuadTree(targetPercentage);
+
+    if (!qt.getErrorMessage().empty()) {
+        result.errorMessage = qt.getErrorMessage();
+        return result;
+    }
+
+    result.width = width;
+    result.height = height;
+    result.channels = channels;
+    result.pixels.assign(ctx.currImgData, ctx.currImgData + (size_t)width * height * channels);
+    result.executionTime = qt.getExecutionTime();
+    result.initialSize = qt.getInitialSize();
+    result.finalSize = qt.getFinalSize();
+    result.compressionPercentage = qt.getCompressionPercentage();
+    result.quadtreeDepth = qt.getQuadtreeDepth();
+    result.quadtreeNode = qt.getQuadtreeNode();
+
+    return result;
+}
@@ -0,0 +1,56 @@
+#ifndef QUADPRESSOR_HPP
+#define QUADPRESSOR_HPP
+
+// Libraries
+#include <string>
+#include <vector>
+
+/**
+ * @brief Result of an in-memory compression
+ * @param pixels Compressed pixel data, same layout and channel count as the input
+ * @param width Width of the image in pixels
+ * @param height Height of the image in pixels
+ * @param channels Number of color channels
+ * @param executionTime Compression time in milliseconds
+ * @param initialSize Encoded size of the input pixels in bytes
+ * @param finalSize Encoded size of the compressed pixels in bytes
+ * @param compressionPercentage Achieved compression percentage
+ * @param quadtreeDepth Maximum depth of the quadtree
+ * @param quadtreeNode Number of nodes in the quadtree
+ * @param errorMessage Error message, empty if the compression succeeded
+ */
+struct CompressionResult {
+    std::vector<unsigned char> pixels;
+    int width = 0, height = 0, channels = 0;
+    int executionTime = 0;
+    int initialSize = 0, finalSize = 0;
+    double compressionPercentage = 0;
+    int quadtreeDepth = 0, quadtreeNode = 0;
+    std::string errorMessage;
+};
+
+/**
+ * @brief Embeddable quadtree compressor working on decoded pixel buffers, without any file access
+ */
+class Quadpressor {
+
+    public:
+        /**
+         * @brief Compress a decoded image held in memory
+         * @param pixels Interleaved 8-bit pixel data, row-major without padding
+         * @param width Width of the image in pixels
+         * @param height Height of the image in pixels
+         * @param channels Number of color channels (3 for RGB, 4 for RGBA)
+         * @param mode Error calculation mode (1-5)
+         * @param threshold Error threshold value, ignored when targetPercentage is set
+         * @param minBlock Minimum block size in pixels
+         * @param targetPercentage Target compression percentage (0-1) relative to the input encoded in format, 0 to use the threshold
+         * @param format Encoding used to measure sizes, "png" or "jpg"
+         * @param quality JPG quality used when format is "jpg"
+         * @param threads Number of threads building the quadtree, the result is the same for any count
+         * @return Compressed pixels and statistics, with errorMessage set if the input was rejected
+         */
+        static CompressionResult compress(const unsigned char* pixels, int width, int height, int channels, int mode, double threshold, int minBlock, double targetPercentage = 0, const std::string& format = "png", int quality = 90, int threads = 1);
+};
+
+#endif
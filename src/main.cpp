@@ -1,24 +1,193 @@
 #include "core/IO.hpp"
+#include "core/Batch.hpp"
+#include "core/Benchmark.hpp"
+
+atomic<bool> done(false);
 
 /**
- * @brief Image data buffers used throughout the compression process
- * @param currImgData Current image data buffer used for processing
- * @param initImgData Initial image data buffer kept as reference
- * @param tempImgData Temporary image data buffer for intermediate processing
+ * @brief Run a batch compression over a directory or manifest on a pool of worker threads
+ * @param IO Validated command-line flags
+ * @return Process exit code
  */
-unsigned char *currImgData = nullptr, *initImgData = nullptr, *tempImgData = nullptr;
-extern int compressionQuality;
-atomic<bool> done(false);
+int runBatch(IOHandler& IO)
+{
+    BatchCompressor batch(IO.getMode(), IO.getThreshold(), IO.getMinBlock(), IO.getTargetPercentage(), IO.getJobs());
+    batch.setSizeEstimation(IO.isEstimateSize(), IO.isConfirmSize());
+    batch.setLowMemory(IO.isLowMemory());
+    batch.setTileSize(IO.getTileSize());
+
+    string errorMsg = batch.collectInputs(IO.getBatchPath(), IO.getOutputDir());
+    if (!errorMsg.empty()) {
+        cerr << "Error: " << errorMsg << endl;
+        return 1;
+    }
+
+    batch.run();
+
+    for (const auto& result : batch.getResults()) {
+        if (!result.errorMessage.empty()) cerr << "Error: " << result.inputPath << ": " << result.errorMessage << endl;
+    }
+
+    cout << "images: " << batch.getResults().size() << endl;
+    cout << "failed: " << batch.getFailedCount() << endl;
+    cout << "jobs: " << batch.getJobs() << endl;
+    cout << "elapsed_ms: " << batch.getElapsedMs() << endl;
+    cout << "input_bytes: " << batch.getTotalInputSize() << endl;
+    cout << "output_bytes: " << batch.getTotalFinalSize() << endl;
+    cout << "images_per_sec: " << batch.getImagesPerSecond() << endl;
+    cout << "mb_per_sec: " << batch.getMegabytesPerSecond() << endl;
+    cout << "peak_rss_kb: " << IOHandler::getPeakMemoryKB() << endl;
+
+    return batch.getFailedCount() == 0 ? 0 : 1;
+}
+
+/**
+ * @brief Run the benchmark cases over a directory or manifest and print the report
+ * @param IO Validated command-line flags
+ * @return Process exit code
+ */
+int runBench(IOHandler& IO)
+{
+    BenchmarkRunner bench(IO.getMinBlock(), IO.getJobs(), IO.getBenchRepeat());
+    bench.setLowMemory(IO.isLowMemory());
+
+    string errorMsg = bench.run(IO.getBenchPath(), IO.getOutputDir(), &cerr);
+    if (!errorMsg.empty()) {
+        cerr << "Error: " << errorMsg << endl;
+        return 1;
+    }
+
+    for (const auto& result : bench.getResults()) {
+        if (!result.errorMessage.empty()) cerr << "Error: " << result.inputPath << ": " << result.errorMessage << endl;
+    }
+
+    if (IO.getBenchFormat() == "json") bench.writeJson(cout);
+    else bench.writeCsv(cout);
+
+    return bench.getFailedCount() == 0 ? 0 : 1;
+}
+
+/**
+ * @brief Decode a .qtz file into an image
+ * @param IO Validated command-line flags
+ * @return Process exit code
+ */
+int runDecode(IOHandler& IO)
+{
+    auto startTime = chrono::steady_clock::now();
+
+    vector<unsigned char> image;
+    int width = 0, height = 0, channels = 0;
+    string errorMsg = QuadTreeCodec::decode(IO.getDecodePath(), image, width, height, channels, IO.getMaxDepth(), IO.getMaxBytes());
+    if (!errorMsg.empty()) {
+        cerr << "Error: " << errorMsg << endl;
+        return 1;
+    }
+
+    auto decodeTime = chrono::steady_clock::now();
+
+    string outputPath = IO.getOutputPath();
+    string extension = outputPath.substr(outputPath.find_last_of('.') + 1);
+    int written;
+    if (extension == "png") written = stbi_write_png(outputPath.c_str(), width, height, channels, image.data(), width * channels);
+    else written = stbi_write_jpg(outputPath.c_str(), width, height, channels, image.data(), 90);
+    if (!written) {
+        cerr << "Error: Output-nya gagal ditulis." << endl;
+        return 1;
+    }
+
+    cout << "decode_time_ms: " << chrono::duration_cast<chrono::milliseconds>(decodeTime - startTime).count() << endl;
+    cout << "execution_time_ms: " << chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - startTime).count() << endl;
+    cout << "width: " << width << endl;
+    cout << "height: " << height << endl;
+    cout << "channels: " << channels << endl;
+    cout << "peak_rss_kb: " << IOHandler::getPeakMemoryKB() << endl;
+
+    return 0;
+}
+
+/**
+ * @brief Run a single compression from command-line flags, without prompts, animation, or styling
+ * @param argc Argument count
+ * @param argv Argument values
+ * @return Process exit code
+ */
+int runCommandLine(int argc, char* argv[])
+{
+    ImageContext ctx;
+    IOHandler IO(ctx, argc, argv);
+
+    if (IO.isHelpRequested()) {
+        IOHandler::showUsage();
+        return 0;
+    }
+
+    if (!IO.getErrorMessage().empty()) {
+        cerr << "Error: " << IO.getErrorMessage() << endl;
+        return 1;
+    }
+
+    if (!IO.getBatchPath().empty()) return runBatch(IO);
+    if (!IO.getDecodePath().empty()) return runDecode(IO);
+    if (!IO.getBenchPath().empty()) return runBench(IO);
+
+    QuadTree qt(ctx,
+                IO.getInputPath(), 
+                IO.getMode(), 
+                IO.getThreshold(), 
+                IO.getMinBlock(),
+                IO.getTargetPercentage(), 
+                IO.getOutputPath(), 
+                IO.getGifPath(), 
+                IO.getInputExtension());
+
+    qt.setThreads(IO.getJobs() > 0 ? IO.getJobs() : thread::hardware_concurrency());
+    qt.setSizeEstimation(IO.isEstimateSize(), IO.isConfirmSize());
+    qt.setLevelLayout(IO.isLevelLayout());
+    qt.setTileSize(IO.getTileSize());
 
-int main()
+    if (IO.getTargetPercentage() == 0) qt.performQuadTree();
+    else qt.performBinserQuadTree(IO.getTargetPercentage());
+
+    if (!qt.getErrorMessage().empty()) {
+        cerr << "Error: " << qt.getErrorMessage() << endl;
+        return 1;
+    }
+
+    cout << "execution_time_ms: " << qt.getExecutionTime() << endl;
+    cout << "initial_size: " << qt.getInitialSize() << endl;
+    cout << "final_size: " << qt.getFinalSize() << endl;
+    cout << "compression_percentage: " << qt.getCompressionPercentage() << endl;
+    cout << "quadtree_depth: " << qt.getQuadtreeDepth() << endl;
+    cout << "quadtree_node: " << qt.getQuadtreeNode() << endl;
+    cout << "peak_rss_kb: " << IOHandler::getPeakMemoryKB() << endl;
+
+    if (!IO.getStatsPath().empty()) {
+        ofstream statsFile(IO.getStatsPath());
+        IO.getStats().writeJson(statsFile);
+        if (!statsFile) {
+            cerr << "Error: Stats-nya gagal ditulis." << endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char* argv[])
 {
+    // ~~ Command-line mode ~~
+    if (argc > 1) return runCommandLine(argc, argv);
+
     // ~~ IO ~~
-    IOHandler IO;
+    ImageContext ctx;
+    IOHandler IO(ctx);
     cout << BRIGHT_YELLOW << "Input" << BRIGHT_GREEN << " done." << endl;
 
 
     //~~ Quadtree Compression Process ~~
-    QuadTree qt(IO.getInputPath(), 
+    QuadTree qt(ctx,
+                IO.getInputPath(), 
                 IO.getMode(), 
                 IO.getThreshold(), 
                 IO.getMinBlock(),
@@ -48,25 +217,10 @@ int main()
     cout << RESET MAGENTA BOLD << "[-]" << RESET BRIGHT_WHITE << " Compression percentage: " << BRIGHT_GREEN << qt.getCompressionPercentage() << " %" << endl;
     cout << RESET MAGENTA BOLD << "[-]" << RESET BRIGHT_WHITE << " Quadtree depth: " << BRIGHT_GREEN << qt.getQuadtreeDepth() << endl;
     cout << RESET MAGENTA BOLD << "[-]" << RESET BRIGHT_WHITE << " Quadtree node: " << BRIGHT_GREEN << qt.getQuadtreeNode() << endl;
+    cout << RESET MAGENTA BOLD << "[-]" << RESET BRIGHT_WHITE << " Peak memory: " << BRIGHT_GREEN << IOHandler::getPeakMemoryKB() / 1024 << " MB" << endl;
     cout << endl;
 
     
-    //~~ Free Memory ~~
-    if (currImgData != nullptr) {
-        free(currImgData);
-        currImgData = nullptr;
-    }
-
-    if (initImgData != nullptr) {
-        free(initImgData);
-        initImgData = nullptr;
-    }
-
-    if (tempImgData != nullptr) {
-        free(tempImgData);
-        tempImgData = nullptr;
-    }
-
     cout << RESET;
     return 0;
 }
\ No newline at end of file